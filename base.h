@@ -68,18 +68,22 @@ struct ProbInterval {
 };
 
 /*
- * Structure used to represent unit probability interval (i.e., [n/2^k, (n+1)/2^k])
+ * Non-owning view of the k - 1 probability segment boundaries of k branches, which are
+ * usually kept in the tables of a model. The viewed boundaries must outlive the view.
  */
-struct UnitProbInterval {
-    long long num;
-    char exp;
-    UnitProbInterval(int num_, char exp_) : num(num_), exp(exp_) {}
-    Prob Left() { return Prob(num, exp); }
-    Prob Right() { return Prob(num + 1, exp); }
-    Prob Mid() { return Prob((num << 1) + 1, exp + 1); }
-    ProbInterval GetProbInterval() { return ProbInterval(Left(),Right()); }
-    void GoLeft() { num <<= 1; ++ exp; }
-    void GoRight() { num <<= 1; ++ exp; ++ num; }
+class ProbSegs {
+  private:
+    const Prob* segs_;
+    size_t size_;
+  public:
+    ProbSegs() : segs_(NULL), size_(0) {}
+    ProbSegs(const Prob* segs, size_t size) : segs_(segs), size_(size) {}
+    explicit ProbSegs(const std::vector<Prob>& segs) :
+        segs_(segs.data()), size_(segs.size()) {}
+    // A temporary vector would not outlive the view
+    explicit ProbSegs(std::vector<Prob>&& segs) = delete;
+    const Prob& operator[](size_t index) const { return segs_[index]; }
+    size_t size() const { return size_; }
 };
 
 }
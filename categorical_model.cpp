@@ -18,11 +18,136 @@ std::vector<size_t> GetPredictorCap(const Schema& schema, const std::vector<size
     return cap;
 }
 
+// Return the number of cells of the dense table, or 0 if some predictor is not enum
+// interpretable. The product saturates at limit + 1.
+unsigned long long GetTableSize(const Schema& schema, const std::vector<size_t>& predictor,
+                                unsigned long long limit) {
+    unsigned long long table_size = 1;
+    for (size_t i = 0; i < predictor.size(); ++i) {
+        int attr_type = schema.attr_type[predictor[i]];
+        if (!GetAttrInterpreter(attr_type)->EnumInterpretable())
+            return 0;
+        unsigned long long cap = GetAttrInterpreter(attr_type)->EnumCap();
+        if (cap > 0 && table_size > limit / cap)
+            return limit + 1;
+        table_size *= cap;
+    }
+    return table_size;
+}
+
+bool IsEnumInterpretable(const Schema& schema, const std::vector<size_t>& predictor) {
+    for (size_t i = 0; i < predictor.size(); ++i)
+    if (!GetAttrInterpreter(schema.attr_type[predictor[i]])->EnumInterpretable())
+        return false;
+    return true;
+}
+
+size_t GetCellSize(size_t target_range) { return (target_range > 100 ? 16 : 8); }
+
+// The memory used by each cell to decode
+size_t GetCellBytes(size_t target_range) {
+    // Each value takes one branch, the inverse CDF tables are only built for more than two
+    // categories
+    size_t cell_bytes = sizeof(CategoricalStats);
+    if (target_range > 0)
+        cell_bytes += (target_range - 1) * sizeof(Prob);
+    if (target_range > 2)
+        cell_bytes += (target_range + 1) * sizeof(unsigned)
+                      + (1 << kLookupBits) * sizeof(unsigned short);
+    return cell_bytes;
+}
+
+// The number of target values assumed when the target attribute has no enum cap
+const size_t kDefaultTargetRange = 256;
+
+// The memory used by each cell until EndOfData, the target is assumed to take all the
+// values of its enum cap
+size_t GetCellFootprint(const Schema& schema, size_t target_var) {
+    const AttrInterpreter* interpreter = GetAttrInterpreter(schema.attr_type[target_var]);
+    size_t target_range = kDefaultTargetRange;
+    if (interpreter->EnumInterpretable() && interpreter->EnumCap() > 0)
+        target_range = interpreter->EnumCap();
+    return GetCellBytes(target_range) + target_range * sizeof(int);
+}
+
+/*
+ * Set the quantized probability segments of the cell from the counts in the given row,
+ * return the cost of the tuples in the cell and set total_count to their number.
+ */
+double QuantizeCell(const CountMatrix& counts, size_t row, size_t target_range,
+                    size_t cell_size, double err, CategoricalStats* stats, int* total_count) {
+    std::vector<int> count(target_range);
+    for (size_t j = 0; j < target_range; ++j)
+        count[j] = counts.GetCount(row, j);
+    std::vector<Prob> prob;
+
+    // Mark empty entries, since we are allowed to make mistakes,
+    // we can mark entries that rarely appears as empty
+    int current_tol = 0;
+    *total_count = 0;
+    for (size_t j = 0; j < count.size(); ++j )
+        *total_count += count[j];
+    for (size_t j = 0; j < count.size(); ++j )
+    if (count[j] + current_tol <= *total_count * err) {
+        current_tol += count[j];
+        count[j] = 0;
+    }
+    // We add back the mistake count to the most likely category
+    size_t most_likely_category = 0;
+    for (size_t j = 0; j < count.size(); ++j )
+    if (count[j] > count[most_likely_category])
+        most_likely_category = j;
+    count[most_likely_category] += current_tol;
+
+    // Quantization
+    Quantization(&prob, count, cell_size);
+
+    double cost = 0;
+    for (size_t j = 0; j < count.size(); j++ )
+    if (count[j] > 0) {
+        Prob p = (j == count.size() - 1 ? GetOneProb() : prob[j])
+                    - (j == 0 ? GetZeroProb() : prob[j - 1]);
+        cost += count[j] * (- log2(CastDouble(p)) );
+    }
+    stats->prob = prob;
+    return cost;
+}
+
+void WriteCell(const CategoricalStats& stats, size_t cell_size,
+               ByteWriter* byte_writer, size_t block_index) {
+    const std::vector<Prob>& prob_segs = stats.prob;
+    for (size_t j = 0; j < prob_segs.size(); ++j ) {
+        int code = CastInt(prob_segs[j], cell_size);
+        if (cell_size == 16) {
+            byte_writer->Write16Bit(code, block_index);
+        } else {
+            byte_writer->WriteByte(code, block_index);
+        }
+    }
+}
+
+void ReadCell(ByteReader* byte_reader, size_t target_range, size_t cell_size,
+              CategoricalStats* stats) {
+    std::vector<Prob>& prob_segs = stats->prob;
+    prob_segs.resize(target_range - 1);
+    for (size_t j = 0; j < prob_segs.size(); ++j )
+    if (cell_size == 16) {
+        prob_segs[j] = GetProb(byte_reader->Read16Bit(), 16);
+    } else {
+        prob_segs[j] = GetProb(byte_reader->ReadByte(), 8);
+    }
+    // For binary attributes, binary search only takes one comparison
+    if (target_range > 2)
+        stats->inverse_cdf.Build(prob_segs);
+}
+
 }  // anonymous namespace
 
-inline void CategoricalSquID::Init(const std::vector<Prob>& prob_segs) {
+inline void CategoricalSquID::Init(const std::vector<Prob>& prob_segs,
+                                   const InverseCDFTable* inverse_cdf) {
     choice_ = -1;
-    prob_segs_ = prob_segs;
+    prob_segs_ = ProbSegs(prob_segs);
+    inverse_cdf_ = inverse_cdf;
 }
 
 int CategoricalSquID::GetNextBranch(const AttrValue* attr) const {
@@ -51,87 +176,56 @@ TableCategorical::TableCategorical(const Schema& schema,
     cell_size_(0),
     err_(err),
     model_cost_(0),
-    dynamic_list_(GetPredictorCap(schema, predictor_list)) {
+    decode_cost_(0),
+    cell_footprint_(GetCellFootprint(schema, target_var)),
+    dynamic_list_(GetPredictorCap(schema, predictor_list)),
+    count_(dynamic_list_.size()) {
     for (size_t i = 0; i < predictor_list_.size(); ++i) {
         predictor_interpreter_[i] = GetAttrInterpreter(schema.attr_type[predictor_list[i]]);
     }
 }
 
-SquID* TableCategorical::GetSquID(const Tuple& tuple) {
-    std::vector<size_t> index;
-    GetDynamicListIndex(tuple, &index);
-    squid_.Init(dynamic_list_[index].prob);
-    return &squid_; 
+void TableCategorical::InitSquID(const Tuple& tuple, SquID* squid) const {
+    const CategoricalStats& stats = dynamic_list_[GetDynamicListPos(tuple)];
+    static_cast<CategoricalSquID*>(squid)->Init(stats.prob, 
+        stats.inverse_cdf.IsBuilt() ? &stats.inverse_cdf : NULL);
 }
 
-void TableCategorical::GetDynamicListIndex(const Tuple& tuple, std::vector<size_t>* index) {
-    index->clear();
-    for (size_t i = 0; i < predictor_list_.size(); ++i ) {
-        const AttrValue* attr = tuple.attr[predictor_list_[i]];
-        size_t val = predictor_interpreter_[i]->EnumInterpret(attr);
-        index->push_back(val);
-    }
+size_t TableCategorical::GetDynamicListPos(const Tuple& tuple) const {
+    return dynamic_list_.GetPos([&](size_t i) -> size_t {
+        return predictor_interpreter_[i]->EnumInterpret(tuple.attr[predictor_list_[i]]);
+    });
 }
 
 void TableCategorical::FeedTuple(const Tuple& tuple) {
-    std::vector<size_t> predictors;
-    GetDynamicListIndex(tuple, &predictors);
     const AttrValue* attr = tuple.attr[target_var_];
     size_t target_val = static_cast<const EnumAttrValue*>(attr)->Value();
     if (target_val >= target_range_)
         target_range_ = target_val + 1;
    
-    CategoricalStats& vec = dynamic_list_[predictors];
-    if (vec.count.size() <= target_val) {
-        vec.count.resize(target_val + 1);
-        vec.count.shrink_to_fit();
-    }
-    ++ vec.count.at(target_val);
+    count_.AddCount(GetDynamicListPos(tuple), target_val, 1);
+}
+
+void TableCategorical::Merge(const SquIDModel& model) {
+    const TableCategorical& other = static_cast<const TableCategorical&>(model);
+    if (other.target_range_ > target_range_)
+        target_range_ = other.target_range_;
+    for (size_t i = 0; i < dynamic_list_.size(); ++i )
+        count_.MergeRow(i, other.count_, i);
 }
 
 void TableCategorical::EndOfData() {
     // Determine cell size
-    cell_size_ = (target_range_ > 100 ? 16 : 8);
+    cell_size_ = GetCellSize(target_range_);
+    size_t table_bytes = dynamic_list_.size() * GetCellBytes(target_range_);
+    double branch_cost = 1 + GetTableLookupCost(predictor_list_.size(), table_bytes);
     for (size_t i = 0; i < dynamic_list_.size(); ++i ) {
-        CategoricalStats& stats = dynamic_list_[i];
-        // Extract count vector
-        std::vector<int> count;
-        count.swap(stats.count);
-
-        // We might need to resize count vector
-        count.resize(target_range_);
-        std::vector<Prob> prob;
-
-        // Mark empty entries, since we are allowed to make mistakes,
-        // we can mark entries that rarely appears as empty
-        int total_count = 0, current_tol = 0;
-        for (size_t j = 0; j < count.size(); ++j )
-            total_count += count[j];
-        for (size_t j = 0; j < count.size(); ++j )
-        if (count[j] + current_tol <= total_count * err_) {
-            current_tol += count[j];
-            count[j] = 0;
-        }
-        // We add back the mistake count to the most likely category
-        size_t most_likely_category = 0;
-        for (size_t j = 0; j < count.size(); ++j )
-        if (count[j] > count[most_likely_category])
-            most_likely_category = j;
-        count[most_likely_category] += current_tol;
-
-        // Quantization
-        Quantization(&prob, count, cell_size_);     
-
-        // Update model cost
-        for (size_t j = 0; j < count.size(); j++ )
-        if (count[j] > 0) {
-            Prob p = (j == count.size() - 1 ? GetOneProb() : prob[j])
-                        - (j == 0 ? GetZeroProb() : prob[j - 1]);
-            model_cost_ += count[j] * (- log2(CastDouble(p)) ); 
-        }
-        // Write back to dynamic list
-        stats.prob = prob;
+        int total_count;
+        model_cost_ += QuantizeCell(count_, i, target_range_, cell_size_, err_,
+                                    &dynamic_list_[i], &total_count);
+        decode_cost_ += total_count * branch_cost;
     }
+    count_.Clear();
     // Add model description length to model cost
     model_cost_ += GetModelDescriptionLength();
 }
@@ -143,6 +237,20 @@ int TableCategorical::GetModelDescriptionLength() const {
             + predictor_list_.size() * 16 + 32;
 }
 
+/*
+ * The target range and the cell size only depend on the values of the target variable,
+ * so the model description length is known from the reference model, while the cost of
+ * the tuples is never negative.
+ */
+int TableCategorical::GetModelCostLowerBound(const SquIDModel& reference) const {
+    const TableCategorical& other = static_cast<const TableCategorical&>(reference);
+    if (other.target_range_ == 0)
+        return 0;
+    size_t table_size = dynamic_list_.size();
+    return table_size * (other.target_range_ - 1) * other.cell_size_
+            + predictor_list_.size() * 16 + 32;
+}
+
 void TableCategorical::WriteModel(ByteWriter* byte_writer,
                                   size_t block_index) const {
     // Write Model Description Prefix
@@ -154,17 +262,8 @@ void TableCategorical::WriteModel(ByteWriter* byte_writer,
 
     // Write Model Parameters
     size_t table_size = dynamic_list_.size();
-    for (size_t i = 0; i < table_size; ++i ) {
-        std::vector<Prob> prob_segs = dynamic_list_[i].prob;
-        for (size_t j = 0; j < prob_segs.size(); ++j ) {
-            int code = CastInt(prob_segs[j], cell_size_);
-            if (cell_size_ == 16) {
-                byte_writer->Write16Bit(code, block_index);
-            } else {
-                byte_writer->WriteByte(code, block_index);
-            }
-        }
-    }
+    for (size_t i = 0; i < table_size; ++i )
+        WriteCell(dynamic_list_[i], cell_size_, byte_writer, block_index);
 }
 
 SquIDModel* TableCategorical::ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index) {
@@ -183,16 +282,8 @@ SquIDModel* TableCategorical::ReadModel(ByteReader* byte_reader, const Schema& s
 
     // Read Model Parameters
     size_t table_size = model->dynamic_list_.size();
-    for (size_t i = 0; i < table_size; ++i ) {
-        std::vector<Prob>& prob_segs = model->dynamic_list_[i].prob;
-        prob_segs.resize(target_range - 1);
-        for (size_t j = 0; j < prob_segs.size(); ++j ) 
-        if (cell_size == 16) { 
-            prob_segs[j] = GetProb(byte_reader->Read16Bit(), 16);
-        } else {
-            prob_segs[j] = GetProb(byte_reader->ReadByte(), 8);
-        }
-    }
+    for (size_t i = 0; i < table_size; ++i )
+        ReadCell(byte_reader, target_range, cell_size, &model->dynamic_list_[i]);
     
     return model;
 }
@@ -204,16 +295,202 @@ SquIDModel* TableCategoricalCreator::ReadModel(ByteReader* byte_reader,
 
 SquIDModel* TableCategoricalCreator::CreateModel(const Schema& schema,
             const std::vector<size_t>& predictor, size_t index, double err) {
-    size_t table_size = 1;
-    for (size_t i = 0; i < predictor.size(); ++i) {
-        int attr_type = schema.attr_type[predictor[i]];
-        if (!GetAttrInterpreter(attr_type)->EnumInterpretable())
-            return NULL;
-        table_size *= GetAttrInterpreter(attr_type)->EnumCap();
-    }
-    if (table_size > MAX_TABLE_SIZE)
+    if (!IsEnumInterpretable(schema, predictor))
+        return NULL;
+    if (GetTableSize(schema, predictor, MAX_TABLE_SIZE) > MAX_TABLE_SIZE)
         return NULL;
     return new TableCategorical(schema, predictor, index, err);
 }
 
+SparseTableCategorical::SparseTableCategorical(const Schema& schema,
+                                               const std::vector<size_t>& predictor_list,
+                                               size_t target_var,
+                                               double err,
+                                               size_t max_num_of_cells) :
+    SquIDModel(predictor_list, target_var),
+    predictor_interpreter_(predictor_list_.size()),
+    target_range_(0),
+    cell_size_(0),
+    err_(err),
+    model_cost_(0),
+    decode_cost_(0),
+    cell_footprint_(GetCellFootprint(schema, target_var)),
+    max_num_of_cells_(max_num_of_cells),
+    sparse_list_(GetPredictorCap(schema, predictor_list),
+                 max_num_of_cells * kSparseLearningFactor),
+    count_(0),
+    fallback_count_(1),
+    num_of_fallback_tuples_(0) {
+    for (size_t i = 0; i < predictor_list_.size(); ++i) {
+        predictor_interpreter_[i] = GetAttrInterpreter(schema.attr_type[predictor_list[i]]);
+    }
+}
+
+size_t SparseTableCategorical::GetSparseListPos(const Tuple& tuple) const {
+    return sparse_list_.GetPos([&](size_t i) -> size_t {
+        return predictor_interpreter_[i]->EnumInterpret(tuple.attr[predictor_list_[i]]);
+    });
+}
+
+void SparseTableCategorical::InitSquID(const Tuple& tuple, SquID* squid) const {
+    const CategoricalStats* stats = sparse_list_.Find(GetSparseListPos(tuple));
+    if (stats == NULL)
+        stats = &fallback_;
+    static_cast<CategoricalSquID*>(squid)->Init(stats->prob,
+        stats->inverse_cdf.IsBuilt() ? &stats->inverse_cdf : NULL);
+}
+
+void SparseTableCategorical::FeedTuple(const Tuple& tuple) {
+    const AttrValue* attr = tuple.attr[target_var_];
+    size_t target_val = static_cast<const EnumAttrValue*>(attr)->Value();
+    if (target_val >= target_range_)
+        target_range_ = target_val + 1;
+    CategoricalStats* stats = sparse_list_.Insert(GetSparseListPos(tuple));
+    if (stats != NULL)
+        count_.AddCount(GetCountRow(stats), target_val, 1);
+    else
+        ++ num_of_fallback_tuples_;
+    fallback_count_.AddCount(0, target_val, 1);
+}
+
+size_t SparseTableCategorical::GetCountRow(const CategoricalStats* stats) {
+    if (count_.GetNumOfRows() < sparse_list_.size())
+        count_.AddRows(sparse_list_.size() - count_.GetNumOfRows());
+    return sparse_list_.GetIndexOfCell(stats);
+}
+
+void SparseTableCategorical::Merge(const SquIDModel& model) {
+    const SparseTableCategorical& other = static_cast<const SparseTableCategorical&>(model);
+    if (other.target_range_ > target_range_)
+        target_range_ = other.target_range_;
+    for (size_t i = 0; i < other.sparse_list_.size(); ++i ) {
+        CategoricalStats* stats = sparse_list_.Insert(other.sparse_list_.GetPosOfCell(i));
+        if (stats != NULL) {
+            count_.MergeRow(GetCountRow(stats), other.count_, i);
+        } else {
+            for (size_t j = 0; j < other.target_range_; ++j)
+                num_of_fallback_tuples_ += other.count_.GetCount(i, j);
+        }
+    }
+    num_of_fallback_tuples_ += other.num_of_fallback_tuples_;
+    fallback_count_.MergeRow(0, other.fallback_count_, 0);
+}
+
+// The hash table takes the position and about two slots for each cell
+size_t SparseTableCategorical::GetMemoryFootprint() const {
+    return (max_num_of_cells_ * kSparseLearningFactor + 1) *
+           (cell_footprint_ + 2 * sizeof(size_t));
+}
+
+// The tuples of the cells dropped are coded with the fallback cell, which learned them
+void SparseTableCategorical::KeepMostFrequentCells() {
+    if (sparse_list_.size() <= max_num_of_cells_)
+        return;
+    std::vector<int> total_count(sparse_list_.size(), 0);
+    for (size_t i = 0; i < sparse_list_.size(); ++i)
+    for (size_t j = 0; j < target_range_; ++j)
+        total_count[i] += count_.GetCount(i, j);
+    std::vector<size_t> index = sparse_list_.GetMostFrequentCells(max_num_of_cells_,
+        [&](size_t i) { return total_count[i]; });
+    CountMatrix count(index.size());
+    for (size_t i = 0; i < index.size(); ++i) {
+        count.MergeRow(i, count_, index[i]);
+        total_count[index[i]] = 0;
+    }
+    for (size_t i = 0; i < total_count.size(); ++i)
+        num_of_fallback_tuples_ += total_count[i];
+    count_ = std::move(count);
+    sparse_list_.Retain(index);
+}
+
+/*
+ * The fallback cell learns from all the tuples, while only the tuples that did not fit in
+ * the table are coded with it, so they are charged the average cost of the fallback cell.
+ * Looking up the hash table takes about one more step than indexing the dense table. The
+ * cells are quantized before sorting, while they are still in the order of the count rows.
+ */
+void SparseTableCategorical::EndOfData() {
+    KeepMostFrequentCells();
+    cell_size_ = GetCellSize(target_range_);
+    double branch_cost = 1 + GetTableLookupCost(predictor_list_.size() + 1,
+        (sparse_list_.size() + 1) * (GetCellBytes(target_range_) + sizeof(size_t)));
+    for (size_t i = 0; i < sparse_list_.size(); ++i ) {
+        int total_count;
+        model_cost_ += QuantizeCell(count_, i, target_range_, cell_size_, err_,
+                                    &sparse_list_[i], &total_count);
+        decode_cost_ += total_count * branch_cost;
+    }
+    int total_count;
+    double fallback_cost = QuantizeCell(fallback_count_, 0, target_range_, cell_size_, err_,
+                                        &fallback_, &total_count);
+    count_.Clear();
+    fallback_count_.Clear();
+    sparse_list_.Sort();
+    if (total_count > 0)
+        model_cost_ += fallback_cost * num_of_fallback_tuples_ / total_count;
+    decode_cost_ += num_of_fallback_tuples_ * branch_cost;
+    model_cost_ += GetModelDescriptionLength();
+}
+
+int SparseTableCategorical::GetModelDescriptionLength() const {
+    // See WriteModel function for details of model description.
+    return (sparse_list_.size() + 1) * (target_range_ - 1) * cell_size_
+            + sparse_list_.size() * 32 + predictor_list_.size() * 16 + 64;
+}
+
+/*
+ * The model description is the same as TableCategorical, except that the table consists
+ * of the number of cells, the position of each cell in the dense table followed by its
+ * parameters, and the parameters of the fallback cell.
+ */
+void SparseTableCategorical::WriteModel(ByteWriter* byte_writer,
+                                        size_t block_index) const {
+    byte_writer->WriteByte(predictor_list_.size(), block_index);
+    byte_writer->WriteByte(cell_size_, block_index);
+    for (size_t i = 0; i < predictor_list_.size(); ++i )
+        byte_writer->Write16Bit(predictor_list_[i], block_index);
+    byte_writer->Write16Bit(target_range_, block_index);
+
+    byte_writer->WriteBits(sparse_list_.size(), 32, block_index);
+    for (size_t i = 0; i < sparse_list_.size(); ++i ) {
+        byte_writer->WriteBits(sparse_list_.GetPosOfCell(i), 32, block_index);
+        WriteCell(sparse_list_[i], cell_size_, byte_writer, block_index);
+    }
+    WriteCell(fallback_, cell_size_, byte_writer, block_index);
+}
+
+SquIDModel* SparseTableCategorical::ReadModel(ByteReader* byte_reader,
+                                              const Schema& schema, size_t index) {
+    size_t predictor_size = byte_reader->ReadByte();
+    size_t cell_size = byte_reader->ReadByte();
+    std::vector<size_t> predictor_list;
+    for (size_t i = 0; i < predictor_size; ++i )
+        predictor_list.push_back(byte_reader->Read16Bit());
+    size_t target_range = byte_reader->Read16Bit();
+    size_t table_size = byte_reader->ReadBits(32);
+    // set err to 0 because err is only used in training
+    SparseTableCategorical* model = new SparseTableCategorical(schema, predictor_list, index,
+                                                               0, table_size);
+    model->target_range_ = target_range;
+    for (size_t i = 0; i < table_size; ++i ) {
+        size_t pos = byte_reader->ReadBits(32);
+        ReadCell(byte_reader, target_range, cell_size, model->sparse_list_.Insert(pos));
+    }
+    ReadCell(byte_reader, target_range, cell_size, &model->fallback_);
+    return model;
+}
+
+SquIDModel* SparseTableCategoricalCreator::ReadModel(ByteReader* byte_reader,
+                                                     const Schema& schema, size_t index) {
+    return SparseTableCategorical::ReadModel(byte_reader, schema, index);
+}
+
+SquIDModel* SparseTableCategoricalCreator::CreateModel(const Schema& schema,
+            const std::vector<size_t>& predictor, size_t index, double err) {
+    unsigned long long table_size = GetTableSize(schema, predictor, MAX_TABLE_SIZE);
+    if (table_size <= MIN_TABLE_SIZE || table_size > MAX_TABLE_SIZE)
+        return NULL;
+    return new SparseTableCategorical(schema, predictor, index, err, MAX_NUM_OF_CELLS);
+}
+
 }  // namespace db_compress
@@ -7,6 +7,7 @@
 
 #include "model.h"
 #include "base.h"
+#include "range_coder.h"
 #include "utility.h"
 
 #include <vector>
@@ -24,8 +25,9 @@ class EnumAttrValue: public AttrValue {
 };
 
 struct CategoricalStats {
-    std::vector<int> count;
     std::vector<Prob> prob;
+    // Only built for decoding
+    InverseCDFTable inverse_cdf;
 };
 
 class CategoricalSquID : public SquID {
@@ -33,7 +35,7 @@ class CategoricalSquID : public SquID {
     int choice_;
     EnumAttrValue attr;
   public:
-    inline void Init(const std::vector<Prob>& prob_segs);
+    inline void Init(const std::vector<Prob>& prob_segs, const InverseCDFTable* inverse_cdf);
     bool HasNextBranch() const { return choice_ == -1; }
     void GenerateNextBranch() {}
     int GetNextBranch(const AttrValue* attr) const;
@@ -51,19 +53,29 @@ class TableCategorical : public SquIDModel {
     size_t cell_size_;
     double err_;
     double model_cost_;
-    CategoricalSquID squid_;
+    double decode_cost_;
+    // The estimated bytes of each cell until EndOfData
+    size_t cell_footprint_;
 
     // Each vector consists of k-1 probability segment boundary
     DynamicList<CategoricalStats> dynamic_list_;
-    void GetDynamicListIndex(const Tuple& tuple, std::vector<size_t>* index);
+    // The counts of the target values in each cell, only used in learning
+    CountMatrix count_;
+    // The position of the cell of the tuple in dynamic_list_
+    size_t GetDynamicListPos(const Tuple& tuple) const;
    
   public:
     TableCategorical(const Schema& schema, const std::vector<size_t>& predictor_list, 
                     size_t target_var, double err);
-    SquID* GetSquID(const Tuple& tuple);
+    SquID* CreateSquID() const { return new CategoricalSquID(); }
+    void InitSquID(const Tuple& tuple, SquID* squid) const;
     int GetModelCost() const { return model_cost_; }
+    int GetModelCostLowerBound(const SquIDModel& reference) const;
+    int64_t GetDecodeCost() const { return decode_cost_; }
+    size_t GetMemoryFootprint() const { return dynamic_list_.size() * cell_footprint_; }
     void FeedTuple(const Tuple& tuple);
     void EndOfData();
+    void Merge(const SquIDModel& model);
     int GetModelDescriptionLength() const;
     void WriteModel(ByteWriter* byte_writer, size_t block_index) const;
     static SquIDModel* ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index);
@@ -78,6 +90,77 @@ class TableCategoricalCreator : public ModelCreator {
                        size_t index, double err);
 };
 
+/*
+ * SparseTableCategorical is the variant of TableCategorical for predictors whose dense
+ * table would be too large. Only the observed combinations of predictor values have their
+ * own cells, which are kept in a SparseList of at most max_num_of_cells cells, while the
+ * combinations without cells share the fallback cell, which is learned from all the tuples.
+ * During learning, the first kSparseLearningFactor * max_num_of_cells combinations seen
+ * are counted, and the most frequent max_num_of_cells of them are kept. The result does
+ * not depend on the order of the tuples or of merging unless more combinations occur,
+ * in which case the later ones are only learned by the fallback cell.
+ */
+class SparseTableCategorical : public SquIDModel {
+  private:
+    std::vector<const AttrInterpreter*> predictor_interpreter_;
+    size_t target_range_;
+    size_t cell_size_;
+    double err_;
+    double model_cost_;
+    double decode_cost_;
+    // The estimated bytes of each cell until EndOfData
+    size_t cell_footprint_;
+
+    size_t max_num_of_cells_;
+    SparseList<CategoricalStats> sparse_list_;
+    CategoricalStats fallback_;
+    // The counts of the target values in each cell in the order of insertion, and in the
+    // fallback cell, only used in learning
+    CountMatrix count_;
+    CountMatrix fallback_count_;
+    // The number of tuples learned without a cell, since the table is full
+    int num_of_fallback_tuples_;
+    size_t GetSparseListPos(const Tuple& tuple) const;
+    // Return the count row of a cell of sparse_list_, which is added for new cells
+    size_t GetCountRow(const CategoricalStats* stats);
+    // Keep the max_num_of_cells_ cells with the most tuples in sparse_list_ and count_
+    void KeepMostFrequentCells();
+
+  public:
+    SparseTableCategorical(const Schema& schema, const std::vector<size_t>& predictor_list,
+                           size_t target_var, double err, size_t max_num_of_cells);
+    SquID* CreateSquID() const { return new CategoricalSquID(); }
+    void InitSquID(const Tuple& tuple, SquID* squid) const;
+    int GetModelCost() const { return model_cost_; }
+    int64_t GetDecodeCost() const { return decode_cost_; }
+    size_t GetMemoryFootprint() const;
+    void FeedTuple(const Tuple& tuple);
+    void EndOfData();
+    void Merge(const SquIDModel& model);
+    int GetModelDescriptionLength() const;
+    void WriteModel(ByteWriter* byte_writer, size_t block_index) const;
+    static SquIDModel* ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index);
+};
+
+/*
+ * SparseTableCategoricalCreator only accepts the predictors refused by
+ * TableCategoricalCreator for their table sizes, it should be registered after
+ * TableCategoricalCreator for the same attribute type. The cells of the models are chosen
+ * by frequency among the first kSparseLearningFactor * MAX_NUM_OF_CELLS combinations of
+ * predictor values seen, see SparseTableCategorical.
+ */
+class SparseTableCategoricalCreator : public ModelCreator {
+  private:
+    const size_t MIN_TABLE_SIZE = 1000;
+    // The positions of the cells are written in 32 bits
+    const unsigned long long MAX_TABLE_SIZE = 1ull << 32;
+    const size_t MAX_NUM_OF_CELLS = 10000;
+  public:
+    SquIDModel* ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index);
+    SquIDModel* CreateModel(const Schema& schema, const std::vector<size_t>& predictor,
+                       size_t index, double err);
+};
+
 } // namespace db_compress
 
 #endif
@@ -23,6 +23,15 @@ class MockInterpreter : public AttrInterpreter {
     }
 };
 
+class LargeMockInterpreter : public AttrInterpreter {
+  public:
+    bool EnumInterpretable() const { return true; }
+    int EnumCap() const { return 60000; }
+    int EnumInterpret(const AttrValue* attr) const {
+        return static_cast<const EnumAttrValue*>(attr)->Value();
+    }
+};
+
 const Tuple& GetTuple(size_t a, size_t b, size_t c) {
     vec.clear();
     vec.push_back(EnumAttrValue(a));
@@ -41,6 +50,7 @@ void PrepareData() {
     schema = Schema(schema_);
     pred.push_back(0); pred.push_back(1);
     RegisterAttrInterpreter(0, new MockInterpreter());
+    RegisterAttrInterpreter(1, new LargeMockInterpreter());
 }
 
 void TestProbTree() {
@@ -63,8 +73,9 @@ void TestProbTree() {
                             {GetProb(3,2), GetProb(3,2), GetProb(3,2)},
                             {GetProb(1,2), GetProb(2,2), GetProb(3,2)} };
     int test_ret[4] = {0, 0, 0, 3};
+    SquIDContext context(*model);
     for (int i = 0; i < 4; ++ i) {
-        SquID* tree = model->GetSquID(GetTuple(test_a[i], test_b[i], i));
+        SquID* tree = model->GetSquID(GetTuple(test_a[i], test_b[i], i), &context);
         if (!tree->HasNextBranch())
             std::cerr << "SquID Unit Test Failed!\n";
         if (tree->GetProbSegs().size() != 3)
@@ -91,6 +102,40 @@ void TestModelCost() {
         std::cerr << "Model Cost Unit Test Failed!\n";
     if (model->GetModelCost() != 104)
         std::cerr << "Model Cost Unit Test Failed!\n";
+    // One branch and two predictors for each tuple
+    if (model->GetDecodeCost() != 12)
+        std::cerr << "Decode Cost Unit Test Failed!\n";
+}
+
+void TestModelCostLowerBound() {
+    std::unique_ptr<SquIDModel> reference(GetAttrModel(0)[0]->CreateModel(
+        schema, std::vector<size_t>(), 2, 0));
+    for (int i = 0; i < 2; ++ i)
+    for (int j = 0; j < 2; ++ j)
+    for (int k = 0; k < 2; ++ k)
+        reference->FeedTuple(GetTuple(i, j, k));
+    reference->EndOfData();
+    // The bound is the model description length of TestModelCost
+    std::unique_ptr<SquIDModel> model(GetAttrModel(0)[0]->CreateModel(schema, pred, 2, 0));
+    if (model->GetModelCostLowerBound(*reference) != 96)
+        std::cerr << "Model Cost Lower Bound Unit Test Failed!\n";
+}
+
+void TestMerge() {
+    std::unique_ptr<SquIDModel> model(GetAttrModel(0)[0]->CreateModel(schema, pred, 2, 0));
+    std::unique_ptr<SquIDModel> part(GetAttrModel(0)[0]->CreateModel(schema, pred, 2, 0));
+    // The first part only sees target value 0, so its target range is smaller
+    for (int k = 0; k < 2; ++ k)
+    for (int i = 0; i < 2; ++ i)
+    for (int j = 0; j < 2; ++ j)
+        (k == 0 ? model : part)->FeedTuple(GetTuple(i, j, k));
+    model->Merge(*part);
+    model->EndOfData();
+    // Same as TestModelCost
+    if (model->GetModelDescriptionLength() != 96)
+        std::cerr << "Model Merge Unit Test Failed!\n";
+    if (model->GetModelCost() != 104)
+        std::cerr << "Model Merge Unit Test Failed!\n";
 }
 
 void TestModelDescription() {
@@ -114,9 +159,10 @@ void TestModelDescription() {
             new_model->GetPredictorList()[0] != 0 ||
             new_model->GetPredictorList()[1] != 1)
             std::cerr << "Model Description Unit Test Failed!\n";
+        SquIDContext context(*new_model);
         for (int i = 0; i < 2; ++i)
         for (int j = 0; j < 2; ++j) {
-            SquID* tree = new_model->GetSquID(GetTuple(i, j, 0));
+            SquID* tree = new_model->GetSquID(GetTuple(i, j, 0), &context);
             if (tree->GetProbSegs().size() != 1 ||
                 tree->GetProbSegs()[0] != GetProb(1, 1))
                 std::cerr << "Model Description Unit Test Failed!\n";
@@ -124,11 +170,71 @@ void TestModelDescription() {
     }
 }
 
+// Check the first probability segment of the given predictor values
+void CheckSparseProb(const SquIDModel& model, size_t a, size_t b, Prob prob) {
+    SquIDContext context(model);
+    SquID* tree = model.GetSquID(GetTuple(a, b, 0), &context);
+    if (tree->GetProbSegs().size() != 1 || tree->GetProbSegs()[0] != prob)
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+}
+
+void TestSparseTable() {
+    std::vector<int> attr_type(3, 1);
+    attr_type[2] = 0;
+    Schema sparse_schema(attr_type);
+    TableCategoricalCreator dense_creator;
+    SparseTableCategoricalCreator sparse_creator;
+    // Each creator only accepts the tables the other refuses
+    std::unique_ptr<SquIDModel> dense(dense_creator.CreateModel(sparse_schema, pred, 2, 0));
+    std::unique_ptr<SquIDModel> small(sparse_creator.CreateModel(schema, pred, 2, 0));
+    if (dense != nullptr || small != nullptr)
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+    std::unique_ptr<SquIDModel> model(sparse_creator.CreateModel(sparse_schema, pred, 2, 0));
+    std::unique_ptr<SquIDModel> part(sparse_creator.CreateModel(sparse_schema, pred, 2, 0));
+    // The footprint accounts for all the cells that may be learned before any tuple is fed
+    if (model->GetMemoryFootprint() < kSparseLearningFactor * 10000 * sizeof(CategoricalStats))
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+    // Both cells have four tuples, the full table keeps the one of the smaller position
+    std::unique_ptr<SquIDModel> full(new SparseTableCategorical(sparse_schema, pred, 2, 0, 1));
+    for (int i = 0; i < 8; ++i) {
+        const Tuple& tuple = (i < 4 ? GetTuple(50000, 59999, i / 3) : GetTuple(7, 7, 1));
+        (i % 2 == 0 ? model : part)->FeedTuple(tuple);
+        full->FeedTuple(tuple);
+    }
+    model->Merge(*part);
+    model->EndOfData();
+    full->EndOfData();
+    // Two cells and the fallback cell
+    if (model->GetModelDescriptionLength() != 184)
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+    CheckSparseProb(*model, 50000, 59999, GetProb(3, 2));
+    // Unseen predictor values fall back to the distribution of all the tuples
+    CheckSparseProb(*model, 1, 2, GetProb(3, 3));
+    CheckSparseProb(*full, 50000, 59999, GetProb(3, 3));
+    {
+        std::vector<size_t> block;
+        block.push_back(model->GetModelDescriptionLength());
+        ByteWriter writer(&block, "byte_writer_test.txt");
+        model->WriteModel(&writer, 0);
+    }
+    {
+        ByteReader reader("byte_writer_test.txt");
+        std::unique_ptr<SquIDModel> new_model(sparse_creator.ReadModel(&reader, sparse_schema, 2));
+        if (new_model->GetPredictorList() != pred)
+            std::cerr << "Sparse Table Unit Test Failed!\n";
+        CheckSparseProb(*new_model, 50000, 59999, GetProb(3, 2));
+        CheckSparseProb(*new_model, 1, 2, GetProb(3, 3));
+    }
+}
+
 void Test() {
     PrepareData();
     TestProbTree();
     TestModelCost();
     TestModelDescription();
+    TestMerge();
+    TestModelCostLowerBound();
+    TestSparseTable();
 }
 
 }  // namespace db_compress
@@ -7,6 +7,7 @@
 #include "base.h"
 #include "model.h"
 #include "model_learner.h"
+#include "range_coder.h"
 #include "utility.h"
 
 #include <vector>
@@ -15,73 +16,77 @@ namespace db_compress {
 
 namespace {
 
-void ConvertTupleToBitString(const Tuple& tuple,
-                             const Schema& schema, 
-                             const std::vector< std::unique_ptr<SquIDModel> >& model, 
-                             const std::vector<size_t>& attr_order, 
-                             BitString* bit_string) {
-    Tuple tuple_ = tuple;
-    bit_string->Clear();
-    std::vector<ProbInterval> prob_intervals;
-    for (size_t attr_index : attr_order) {
-        const AttrValue* attr;
-        model[attr_index]->GetProbInterval(tuple_, &prob_intervals, &attr);
-        tuple_.attr[attr_index] = attr;
-    }
-    for (size_t i = 0; i < prob_intervals.size(); ++i) {
-        if (prob_intervals[i].l < GetZeroProb() || prob_intervals[i].r > GetOneProb() ||
-            prob_intervals[i].l >= prob_intervals[i].r) {
-                std::cerr << "Prob Interval Error!\n";
-        }
-    }
-
-    if (prob_intervals.size() > 0) {
-        std::vector<unsigned char> emit_byte;
-        ProbInterval prob = ReducePIProduct(prob_intervals, &emit_byte);
-        for (size_t i = 0; i < emit_byte.size(); ++i) {
-            StrCat(bit_string, emit_byte[i]);
-        }
-        BitString cat;
-        GetBitStringFromProbInterval(&cat, prob);
-        StrCat(bit_string, cat);
-    }
-}
+// The minimum average number of tuples in each segment of the block directory
+const size_t kMinTuplesPerSegment = 1024;
+// Each thread takes several chunks of a batch, which balances the work load
+const size_t kChunksPerThread = 4;
 
 /*
  * Write the bit_string to byte_writer, ignores (prefix_length) bits at beginning.
  */
-void WriteBitString(ByteWriter* byte_writer, const BitString& bit_string,
+void WriteBitString(SpillWriter* spill_writer, const BitString& bit_string,
                     size_t prefix_length, size_t block_index) {
     while (prefix_length < bit_string.length) {
         size_t arr_index = (prefix_length >> 5);
         size_t end_of_block = (arr_index << 5) + 32;
         if (end_of_block > bit_string.length)
             end_of_block = bit_string.length;
-        if (end_of_block >= prefix_length + 8) {
-            unsigned char byte = GetByte(bit_string.bits[arr_index], prefix_length & 31);
-            byte_writer->WriteByte(byte, block_index);
-            prefix_length += 8;
-        } else {
-            unsigned char byte = GetByte(bit_string.bits[arr_index], prefix_length & 31);
-            int write_len = end_of_block - prefix_length;
-            byte_writer->WriteLess(byte >> (8 - write_len), write_len, block_index);
-            prefix_length += write_len;
-        } 
+        // Write the remaining bits of current word at once
+        size_t shift = (arr_index << 5) + 32 - end_of_block;
+        spill_writer->WriteBits(bit_string.bits[arr_index] >> shift,
+                                end_of_block - prefix_length, block_index);
+        prefix_length = end_of_block;
     }
 }
 
 } // anonymous namespace
 
+void TupleEncoder::Init(const std::vector< std::unique_ptr<SquIDModel> >* model,
+                        const std::vector<size_t>* attr_order) {
+    model_ = model;
+    attr_order_ = attr_order;
+    context_.clear();
+    for (size_t i = 0; i < model->size(); ++i)
+        context_.push_back(std::unique_ptr<SquIDContext>(new SquIDContext(*(*model)[i])));
+}
+
+void TupleEncoder::Encode(const Tuple& tuple, BitString* bit_string) {
+    // Vector assignment reuses the existing storage of tuple_
+    tuple_.attr = tuple.attr;
+    bit_string->Clear();
+    prob_intervals_.clear();
+    for (size_t attr_index : *attr_order_) {
+        const AttrValue* attr;
+        (*model_)[attr_index]->GetProbInterval(tuple_, context_[attr_index].get(),
+                                                &prob_intervals_, &attr);
+        tuple_.attr[attr_index] = attr;
+    }
+    for (size_t i = 0; i < prob_intervals_.size(); ++i) {
+        // The interval must not be empty once quantized by the range coder
+        if (prob_intervals_[i].l < GetZeroProb() || prob_intervals_[i].r > GetOneProb() ||
+            GetProbCode(prob_intervals_[i].l) >= GetProbCode(prob_intervals_[i].r)) {
+                std::cerr << "Prob Interval Error!\n";
+        }
+    }
+
+    if (prob_intervals_.size() > 0) {
+        range_encoder_.Init();
+        for (size_t i = 0; i < prob_intervals_.size(); ++i)
+            range_encoder_.Encode(prob_intervals_[i]);
+        range_encoder_.Finish(bit_string);
+    }
+}
+
 Compressor::Compressor(const char *outputFile, const Schema& schema, 
                        const CompressionConfig& config) :
     outputFile_(outputFile),
     schema_(schema),
     learner_(new ModelLearner(schema, config)),
     stage_(0),
-    num_of_tuples_(0) {}
+    num_of_tuples_(0),
+    num_of_threads_(config.num_of_threads < 1 ? 1 : config.num_of_threads) {}
 
-void Compressor::ReadTuple(const Tuple& tuple) {
-    // Validity Check
+void Compressor::CheckTuple(const Tuple& tuple) const {
     for (size_t i = 0; i < schema_.attr_type.size(); ++i) {
         const AttrInterpreter* interpreter = GetAttrInterpreter(schema_.attr_type[i]);
         if (interpreter->EnumInterpretable()) {
@@ -91,7 +96,24 @@ void Compressor::ReadTuple(const Tuple& tuple) {
                 std::cerr << "Error: Negative Enum Interpretation\n";
         }
     }
+}
 
+void Compressor::WriteTuple(BitString* bit_string) {
+    // If the bit_string is shorter than implicit_prefix_length_, we simply pad
+    // zeros to the string, because the arithmetic code is prefix_code, such 
+    // padding will not affect decoding.
+    if (bit_string->length < implicit_prefix_length_) 
+        PadBitString(bit_string, implicit_prefix_length_);
+    int block_index = ComputePrefix(*bit_string, implicit_prefix_length_) + 1;
+    segment_tuples_[(block_index - 1) >> 
+                    (implicit_prefix_length_ - segment_prefix_length_)] ++;
+    // We need to write the prefix 0 of each tuple bit string
+    spill_writer_->WriteBits(0, 1, block_index);
+    WriteBitString(spill_writer_.get(), *bit_string, implicit_prefix_length_, block_index);
+}
+
+void Compressor::ReadTuple(const Tuple& tuple) {
+    CheckTuple(tuple);
     switch (stage_) {
       case 0:
         // Learning Stage
@@ -99,41 +121,50 @@ void Compressor::ReadTuple(const Tuple& tuple) {
         num_of_tuples_ ++;
         break;
       case 1:
-        // Scheduling Stage
-        {
-            BitString bit_string;
-            ConvertTupleToBitString(tuple, schema_, model_, attr_order_, &bit_string);
-            // If the bit_string is shorter than implicit_prefix_length_, we simply pad
-            // zeros to the string, because the arithmetic code is prefix_code, such 
-            // padding will not affect decoding.
-            if (bit_string.length < implicit_prefix_length_) 
-                PadBitString(&bit_string, implicit_prefix_length_);
-            int block_index = ComputePrefix(bit_string, implicit_prefix_length_) + 1;
-            block_length_[block_index] += bit_string.length - implicit_prefix_length_ + 1;
-        }    
-        break;
-      case 2:
         // Compressing Stage
-        {
-            BitString bit_string;
-            ConvertTupleToBitString(tuple, schema_, model_, attr_order_, &bit_string);
-            if (bit_string.length < implicit_prefix_length_) 
-                PadBitString(&bit_string, implicit_prefix_length_);
-            int block_index = ComputePrefix(bit_string, implicit_prefix_length_) + 1;
-            // We need to write the prefix 0 of each tuple bit string
-            byte_writer_->WriteLess(0, 1, block_index);
-            WriteBitString(byte_writer_.get(), bit_string, implicit_prefix_length_, block_index);
-        }    
+        tuple_encoder_.Encode(tuple, &bit_string_);
+        WriteTuple(&bit_string_);
         break;
     }
 }
 
+/*
+ * During learning, the batch is passed to the ModelLearner which feeds the candidate
+ * models concurrently. During compression, the batch is split into chunks of consecutive
+ * tuples, which are encoded concurrently. The bit strings are then written in the
+ * original order, hence the output does not depend on the number of threads.
+ */
+void Compressor::ReadTuples(const std::vector<Tuple>& tuples) {
+    if (stage_ == 2 || num_of_threads_ == 1) {
+        for (size_t i = 0; i < tuples.size(); ++i)
+            ReadTuple(tuples[i]);
+        return;
+    }
+    for (size_t i = 0; i < tuples.size(); ++i)
+        CheckTuple(tuples[i]);
+    if (stage_ == 0) {
+        learner_->FeedTuples(tuples);
+        num_of_tuples_ += tuples.size();
+        return;
+    }
+    if (batch_bit_string_.size() < tuples.size())
+        batch_bit_string_.resize(tuples.size());
+    size_t num_of_chunks = kChunksPerThread * num_of_threads_;
+    size_t chunk_size = (tuples.size() + num_of_chunks - 1) / num_of_chunks;
+    ParallelFor(num_of_chunks, num_of_threads_, [&](int worker, size_t chunk) {
+        TupleEncoder* encoder = (worker == 0 ? &tuple_encoder_ : &worker_encoder_[worker]);
+        for (size_t i = chunk * chunk_size; i < (chunk + 1) * chunk_size && i < tuples.size(); ++i)
+            encoder->Encode(tuples[i], &batch_bit_string_[i]);
+    });
+    for (size_t i = 0; i < tuples.size(); ++i)
+        WriteTuple(&batch_bit_string_[i]);
+}
+
 /*
  * The meaning of stages are as follows:
  *  0: Model Learning Phase (multiple rounds)
- *  1: Writer Scheduling
- *  2: Writing
- *  3: End of Compression
+ *  1: Compressing, the blocks are assembled at the end of this stage
+ *  2: End of Compression
  */
 void Compressor::EndOfData() {
     switch (stage_) {
@@ -147,13 +178,26 @@ void Compressor::EndOfData() {
                 model_[i] = std::move(ptr);
             }
             attr_order_ = learner_->GetOrderOfAttributes();
+            tuple_encoder_.Init(&model_, &attr_order_);
+            worker_encoder_.resize(num_of_threads_);
+            for (int worker = 1; worker < num_of_threads_; ++worker)
+                worker_encoder_[worker].Init(&model_, &attr_order_);
             learner_ = NULL;
             // Calculate length of implicit prefix
             implicit_prefix_length_ = 0;
             while ( (unsigned)(1 << implicit_prefix_length_) < num_of_tuples_ && implicit_prefix_length_ < 16) 
                 implicit_prefix_length_ ++;
             // Since the model occupies one block, there are 2^n + 1 blocks in total.
-            block_length_ = std::vector<size_t>((1 << implicit_prefix_length_) + 1, 0);
+            // The tuples are collected by spill_writer_ until all the block lengths
+            // are known.
+            spill_writer_.reset(new SpillWriter((1 << implicit_prefix_length_) + 1,
+                                                outputFile_ + ".spill"));
+            // Each segment should contain at least kMinTuplesPerSegment tuples on average
+            segment_prefix_length_ = 0;
+            while (segment_prefix_length_ < implicit_prefix_length_ &&
+                   (num_of_tuples_ >> (segment_prefix_length_ + 1)) >= kMinTuplesPerSegment)
+                segment_prefix_length_ ++;
+            segment_tuples_ = std::vector<size_t>(1 << segment_prefix_length_, 0);
         } else {
             // Reset the number of tuples, compute it again in the new round.
             num_of_tuples_ = 0;
@@ -161,32 +205,52 @@ void Compressor::EndOfData() {
         break;
       case 1:
         stage_ = 2;
-        // Compute Model Length
-        block_length_[0] = 24 * schema_.attr_type.size() + 8;
-        for (size_t i = 0; i < schema_.attr_type.size(); ++i )
-            block_length_[0] += model_[i]->GetModelDescriptionLength();
-
-        // Initialize Compressed File
-        for (size_t i = 1; i < block_length_.size(); ++i )
-            block_length_[i] ++;
-        byte_writer_.reset(new ByteWriter(&block_length_, outputFile_));
-        // Write Models
-        byte_writer_->WriteByte(implicit_prefix_length_, 0);
-        for (size_t i = 0; i < attr_order_.size(); ++i )
-            byte_writer_->Write16Bit(attr_order_[i], 0);
-        for (size_t i = 0; i < schema_.attr_type.size(); ++i ) {
-            byte_writer_->WriteByte(model_[i]->GetCreatorIndex(), 0);
-            model_[i]->WriteModel(byte_writer_.get(), 0);
+        {
+            // Mark the end of each block
+            size_t num_of_blocks = (1 << implicit_prefix_length_) + 1;
+            for (size_t i = 1; i < num_of_blocks; ++i )
+                spill_writer_->WriteBits(1, 1, i);
+
+            // Compute Model Length
+            std::vector<size_t> block_length(num_of_blocks);
+            block_length[0] = 24 * schema_.attr_type.size() + 16 + 
+                (kSegmentOffsetBits + kSegmentTuplesBits) * segment_tuples_.size();
+            for (size_t i = 0; i < schema_.attr_type.size(); ++i )
+                block_length[0] += model_[i]->GetModelDescriptionLength();
+
+            // Compute the starting bit offset of each segment
+            for (size_t i = 1; i < num_of_blocks; ++i )
+                block_length[i] = spill_writer_->GetBlockLength(i);
+            size_t blocks_per_segment = 1 << (implicit_prefix_length_ - segment_prefix_length_);
+            std::vector<unsigned long long> segment_offset;
+            unsigned long long offset = 0;
+            for (size_t i = 0; i + 1 < num_of_blocks; ++i ) {
+                offset += block_length[i];
+                if (i % blocks_per_segment == 0)
+                    segment_offset.push_back(offset);
+            }
+
+            // Initialize Compressed File
+            ByteWriter byte_writer(&block_length, outputFile_);
+            // Write Block Directory
+            byte_writer.WriteByte(implicit_prefix_length_, 0);
+            byte_writer.WriteByte(segment_prefix_length_, 0);
+            for (size_t i = 0; i < attr_order_.size(); ++i )
+                byte_writer.Write16Bit(attr_order_[i], 0);
+            for (size_t i = 0; i < segment_tuples_.size(); ++i ) {
+                byte_writer.WriteBits(segment_offset[i], kSegmentOffsetBits, 0);
+                byte_writer.WriteBits(segment_tuples_[i], kSegmentTuplesBits, 0);
+            }
+            // Write Models
+            for (size_t i = 0; i < schema_.attr_type.size(); ++i ) {
+                byte_writer.WriteByte(model_[i]->GetCreatorIndex(), 0);
+                model_[i]->WriteModel(&byte_writer, 0);
+            }
+            // Concatenate the blocks
+            for (size_t i = 1; i < num_of_blocks; ++i )
+                spill_writer_->CopyBlock(i, &byte_writer, i);
         }
-        break;
-      case 2:
-        stage_ = 3;
-        // Mark the end of each block, we can't use block_length_ anymore because
-        // byte_writer_ has taken the ownership of this object.
-        size_t num_of_blocks = (1 << implicit_prefix_length_) + 1;
-        for (size_t i = 1; i < num_of_blocks; ++i )
-            byte_writer_->WriteLess(1, 1, i);
-        byte_writer_ = NULL;
+        spill_writer_ = NULL;
         break;
     }
 }
@@ -7,11 +7,35 @@
 #include "data_io.h"
 #include "model.h"
 #include "model_learner.h"
+#include "range_coder.h"
+#include "utility.h"
 
 #include <vector>
 #include <memory>
 
 namespace db_compress {
+
+/*
+ * TupleEncoder converts tuples into bit strings using the learned models. It owns all the
+ * scratch buffers needed during the conversion, which keep their capacity across tuples,
+ * so that encoding does not allocate memory once the buffers have grown large enough.
+ */
+class TupleEncoder {
+  private:
+    const std::vector< std::unique_ptr<SquIDModel> >* model_;
+    const std::vector<size_t>* attr_order_;
+    // One context for each attribute, so that the models can be shared among encoders
+    std::vector< std::unique_ptr<SquIDContext> > context_;
+    Tuple tuple_;
+    std::vector<ProbInterval> prob_intervals_;
+    RangeEncoder range_encoder_;
+  public:
+    TupleEncoder() : model_(NULL), attr_order_(NULL), tuple_(0) {}
+    void Init(const std::vector< std::unique_ptr<SquIDModel> >* model,
+              const std::vector<size_t>* attr_order);
+    // The previous content of bit_string is discarded
+    void Encode(const Tuple& tuple, BitString* bit_string);
+};
    
 class Compressor {
   private:
@@ -20,15 +44,32 @@ class Compressor {
     std::unique_ptr<ModelLearner> learner_;
     std::vector< std::unique_ptr<SquIDModel> > model_;
     std::vector<size_t> attr_order_;
-    std::unique_ptr<ByteWriter> byte_writer_;
+    std::unique_ptr<SpillWriter> spill_writer_;
     int stage_;
     size_t num_of_tuples_;
     size_t implicit_prefix_length_;
-    std::vector<size_t> block_length_;
+    // The segments are identified by the first segment_prefix_length_ bits of the
+    // implicit prefix
+    size_t segment_prefix_length_;
+    std::vector<size_t> segment_tuples_;
+    TupleEncoder tuple_encoder_;
+    BitString bit_string_;
+    // All the worker threads share model_, each of them owns a TupleEncoder except that
+    // worker 0 uses tuple_encoder_
+    int num_of_threads_;
+    std::vector<TupleEncoder> worker_encoder_;
+    std::vector<BitString> batch_bit_string_;
+
+    void CheckTuple(const Tuple& tuple) const;
+    void WriteTuple(BitString* bit_string);
   public:
     Compressor(const char* outputFile, const Schema& schema, const CompressionConfig& config);
     void ReadTuple(const Tuple& tuple);
-    bool RequireMoreIterations() const { return stage_ != 3; }
+    // Same as calling ReadTuple on each of the tuples in order, but the candidate models
+    // are learned and the tuples are encoded on multiple threads. The attribute values
+    // only need to stay valid during the call.
+    void ReadTuples(const std::vector<Tuple>& tuples);
+    bool RequireMoreIterations() const { return stage_ != 2; }
     bool RequireFullPass() const { return (stage_ > 0 || learner_->RequireFullPass()); }
     void EndOfData();
 };
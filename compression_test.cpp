@@ -40,16 +40,47 @@ void TestCompression() {
     while (fin.get(c)) {
         file.push_back((unsigned char) c);
     }
-    unsigned char correct_answer[] = {1, 0, 0, 0, 1, 0, 2, 0, 2, 0x5c};
-    if (file.size() != 10)
+    // The block directory has one segment starting at bit 160 with 2 tuples
+    unsigned char correct_answer[] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0xa0, 0, 0, 0, 2,
+                                      0, 2, 0, 2, 0x5c};
+    if (file.size() != 21)
         std::cerr << "Compression Unit Test Failed!\n";
-    for (int i = 0; i < 10; ++i)
+    for (int i = 0; i < 21 && i < (int)file.size(); ++i)
     if (file[i] != correct_answer[i])
         std::cerr << "Compression Unit Test Failed!\n";
 }
 
+void TestTupleEncoder() {
+    std::vector< std::unique_ptr<SquIDModel> > model;
+    model.push_back(std::unique_ptr<SquIDModel>(new MockModel(std::vector<size_t>(), 0, 4)));
+    model.push_back(std::unique_ptr<SquIDModel>(new MockModel(std::vector<size_t>(), 1, 2)));
+    std::vector<size_t> attr_order;
+    attr_order.push_back(1);
+    attr_order.push_back(0);
+    TupleEncoder encoder;
+    encoder.Init(&model, &attr_order);
+
+    // [1/2, 1) * [0, 1/4) = [1/2, 5/8), the bit string should be 100
+    BitString bit_string;
+    MockAttr attr0(0), attr1(1);
+    Tuple tuple_(2);
+    tuple_.attr[0] = &attr0;
+    tuple_.attr[1] = &attr1;
+    encoder.Encode(tuple_, &bit_string);
+    if (bit_string.length != 3 || bit_string.bits[0] != 0x80000000)
+        std::cerr << "Tuple Encoder Unit Test Failed!\n";
+    // The buffers are reused, the previous result should not affect the next one
+    // [0, 1/2) * [3/4, 1) = [3/8, 1/2), the bit string should be 011
+    attr0.Set(3);
+    attr1.Set(0);
+    encoder.Encode(tuple_, &bit_string);
+    if (bit_string.length != 3 || bit_string.bits[0] != 0x60000000)
+        std::cerr << "Tuple Encoder Unit Test Failed!\n";
+}
+
 void Test() {
     PrepareData();
+    TestTupleEncoder();
     TestCompression();
 }
 
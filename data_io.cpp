@@ -2,165 +2,367 @@
 
 #include "base.h"
 
+#include <cstdio>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 #include <string>
 
 namespace db_compress {
 
-/*
- * Since the prefix/suffix has at most 7 bits, we can use 0xff as special symbol to indicate
- * that the prefix/suffix is not used yet.
- */
+// The total size of the block buffers before they are written to the file
+const size_t kBufferBudget = 1 << 26;
+
 ByteWriter::ByteWriter(std::vector<size_t>* block_length, const std::string& file_name) :
-    block_unwritten_prefix_(block_length->size()),
-    block_unwritten_suffix_(block_length->size(), 0xff),
-    file_(file_name, std::ios::binary) {
-    block_pos_.swap(*block_length);
+    blocks_(block_length->size()),
+    buffered_bytes_(0),
+    file_(file_name, std::ios::binary),
+    file_pos_(0) {
     size_t total_len = 0;
-    for (size_t i = 0; i < block_pos_.size(); i++) {
-        size_t current_block_len = block_pos_[i];
-        block_pos_[i] = total_len;
-        total_len += current_block_len;
-    }
-    for (size_t i = 0; i < block_pos_.size(); i++) {
-        if ((block_pos_[i] & 7) == 0)
-            block_unwritten_suffix_[i] = 0;
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        BlockBuffer& block = blocks_[i];
+        block.start_pos = (total_len >> 3);
+        block.completed = 0;
+        block.acc = 0;
+        block.acc_len = (total_len & 7);
+        block.shared_head = (block.acc_len != 0);
+        block.head = 0;
+        total_len += (*block_length)[i];
     }
+    // The block lengths are no longer needed
+    block_length->clear();
 }
 
-// Write all the remaining, we can use block_pos_ to identify the prefix/suffix length
-// of corresponding blocks
+/*
+ * Bytes shared by adjacent blocks (the head and the unfinished tail of each block) are
+ * merged here. All the bytes are visited in increasing order of file offsets, so shared
+ * bytes can be merged with the pending one whenever their offsets are the same, and the
+ * writes are contiguous unless part of the blocks have been flushed before.
+ */
 ByteWriter::~ByteWriter() {
-    for (size_t i = 1; i < block_pos_.size(); i++ )
-    if ((block_pos_[i - 1] & 7) != 0) {
-        size_t suffix_length = (block_pos_[i - 1] & 7);
-        if (block_pos_[i] < block_pos_[i - 1] + (8 - suffix_length)) {
-            size_t len = block_pos_[i] - block_pos_[i - 1];
-            block_unwritten_suffix_[i] = 
-                (block_unwritten_suffix_[i - 1] << len)
-                | (block_unwritten_prefix_[i]);
+    bool has_pending = false;
+    size_t pending_pos = 0;
+    unsigned char pending_byte = 0;
+    auto merge = [&](size_t pos, unsigned char byte) {
+        if (has_pending && pending_pos == pos) {
+            pending_byte |= byte;
         } else {
-            file_.seekp(block_pos_[i - 1] >> 3, std::ios_base::beg);
-            unsigned char prefix = block_unwritten_prefix_[i];
-            unsigned char suffix = block_unwritten_suffix_[i - 1];
-            suffix <<= 8 - suffix_length;
-            file_.put(suffix | prefix);
+            if (has_pending)
+                WriteAt(pending_pos, &pending_byte, 1);
+            has_pending = true;
+            pending_pos = pos;
+            pending_byte = byte;
+        }
+    };
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        BlockBuffer& block = blocks_[i];
+        if (block.shared_head && block.completed > 0)
+            merge(block.start_pos, block.head);
+        if (block.bytes.size() > 0) {
+            if (has_pending)
+                WriteAt(pending_pos, &pending_byte, 1);
+            has_pending = false;
+            WriteAt(block.start_pos + block.completed - block.bytes.size(),
+                    &block.bytes[0], block.bytes.size());
+        }
+        if (block.acc_len > 0)
+            merge(block.start_pos + block.completed, block.acc << (8 - block.acc_len));
+    }
+    if (has_pending)
+        WriteAt(pending_pos, &pending_byte, 1);
+}
+
+void ByteWriter::WriteAt(size_t pos, const unsigned char* bytes, size_t len) {
+    if (pos != file_pos_)
+        file_.seekp(pos, std::ios_base::beg);
+    file_.write((const char*)bytes, len);
+    file_pos_ = pos + len;
+}
+
+void ByteWriter::Flush() {
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        BlockBuffer& block = blocks_[i];
+        if (block.bytes.size() > 0) {
+            WriteAt(block.start_pos + block.completed - block.bytes.size(),
+                    &block.bytes[0], block.bytes.size());
+            // Release the memory, otherwise the capacity of all the blocks adds up
+            std::vector<unsigned char>().swap(block.bytes);
         }
     }
-    // The last block needs special care
-    if ((block_pos_[block_pos_.size() - 1] & 7) != 0) {
-        size_t pos = block_pos_[block_pos_.size() - 1];
-        int pad = 8 - (pos & 7);
-        file_.seekp(pos >> 3, std::ios_base::beg);
-        file_.put(block_unwritten_suffix_[block_pos_.size() - 1] << pad);
+    buffered_bytes_ = 0;
+}
+
+inline void ByteWriter::PushByte(BlockBuffer* block, unsigned char byte) {
+    if (block->shared_head && block->completed == 0) {
+        block->head = byte;
+    } else {
+        block->bytes.push_back(byte);
+        ++ buffered_bytes_;
+    }
+    ++ block->completed;
+}
+
+void ByteWriter::WriteBits(unsigned long long bits, size_t len, size_t block) {
+    // The accumulator holds less than 8 bits, so it can take 56 more bits
+    if (len > 56) {
+        WriteBits(bits >> 32, len - 32, block);
+        len = 32;
+    }
+    BlockBuffer& buffer = blocks_[block];
+    bits &= (1ULL << len) - 1;
+    buffer.acc = (buffer.acc << len) | bits;
+    buffer.acc_len += len;
+    while (buffer.acc_len >= 8) {
+        buffer.acc_len -= 8;
+        PushByte(&buffer, (buffer.acc >> buffer.acc_len) & 0xff);
+    }
+    buffer.acc &= (1ULL << buffer.acc_len) - 1;
+    if (buffered_bytes_ >= kBufferBudget)
+        Flush();
+}
+
+void ByteWriter::WriteBytes(const unsigned char* bytes, size_t len, size_t block) {
+    BlockBuffer& buffer = blocks_[block];
+    // The number of bits in the accumulator stays the same after each byte
+    for (size_t i = 0; i < len; ++i) {
+        buffer.acc = (buffer.acc << 8) | bytes[i];
+        PushByte(&buffer, (buffer.acc >> buffer.acc_len) & 0xff);
+        buffer.acc &= (1ULL << buffer.acc_len) - 1;
     }
+    if (buffered_bytes_ >= kBufferBudget)
+        Flush();
 }
 
 void ByteWriter::Write32Bit(unsigned char bytes[4], size_t block) {
-    WriteByte(bytes[0], block);
-    WriteByte(bytes[1], block);
-    WriteByte(bytes[2], block);
-    WriteByte(bytes[3], block);
-}
-
-void ByteWriter::Write16Bit(unsigned int val, size_t block) {
-    val &= 65535;
-    WriteByte(val >> 8, block);
-    WriteByte(val & 255, block);
-}
-
-void ByteWriter::WriteByte(unsigned char byte, size_t block) {
-    WriteLess(byte, 8, block);
-}
-
-void ByteWriter::WriteLess(unsigned char byte, size_t len, size_t block) {
-    file_.seekp(block_pos_[block] >> 3, std::ios_base::beg);
-    byte = (byte & ((1 << len) - 1)); 
-    if (block_unwritten_suffix_[block] != 0xff) {
-        unsigned char suffix = block_unwritten_suffix_[block];
-        size_t needed_len = 8 - (block_pos_[block] & 7);
-        if (needed_len <= len) {
-            len -= needed_len;
-            file_.put((suffix << needed_len) | (byte >> len));
-            byte = byte & ((1 << len) - 1);
-            block_unwritten_suffix_[block] = byte;
-            block_pos_[block] += needed_len + len;
-        } else {
-            block_unwritten_suffix_[block] = ((block_unwritten_suffix_[block] << len) | byte);
-            block_pos_[block] += len;
-        }
+    WriteBits(((unsigned long long)bytes[0] << 24) | (bytes[1] << 16) |
+              (bytes[2] << 8) | bytes[3], 32, block);
+}
+
+// The total size of the block buffers before they are spilled to the temporary file
+const size_t kSpillBudget = 1 << 28;
+
+SpillWriter::SpillWriter(size_t num_of_blocks, const std::string& spill_file_name) :
+    blocks_(num_of_blocks),
+    buffered_bytes_(0),
+    spill_file_name_(spill_file_name),
+    spill_file_len_(0) {
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        blocks_[i].length = 0;
+        blocks_[i].acc = 0;
+        blocks_[i].acc_len = 0;
     }
-    else {
-        size_t needed_len = 8 - (block_pos_[block] & 7);
-        if (needed_len <= len) {
-            len -= needed_len;
-            unsigned char pad = (byte >> len);
-            block_unwritten_prefix_[block] <<= needed_len;
-            block_unwritten_prefix_[block] |= pad;
-            byte = byte & ((1 << len) - 1);
-            block_unwritten_suffix_[block] = byte;
-            block_pos_[block] += needed_len + len;
-        } else {
-            block_unwritten_prefix_[block] = ((block_unwritten_prefix_[block] << len) | byte);
-            block_pos_[block] += len;
+}
+
+SpillWriter::~SpillWriter() {
+    if (spill_file_.is_open()) {
+        spill_file_.close();
+        std::remove(spill_file_name_.c_str());
+    }
+}
+
+void SpillWriter::WriteBits(unsigned long long bits, size_t len, size_t block) {
+    // The accumulator holds less than 8 bits, so it can take 56 more bits
+    if (len > 56) {
+        WriteBits(bits >> 32, len - 32, block);
+        len = 32;
+    }
+    BlockBuffer& buffer = blocks_[block];
+    bits &= (1ULL << len) - 1;
+    buffer.acc = (buffer.acc << len) | bits;
+    buffer.acc_len += len;
+    buffer.length += len;
+    while (buffer.acc_len >= 8) {
+        buffer.acc_len -= 8;
+        buffer.bytes.push_back((buffer.acc >> buffer.acc_len) & 0xff);
+        ++ buffered_bytes_;
+    }
+    buffer.acc &= (1ULL << buffer.acc_len) - 1;
+    if (buffered_bytes_ >= kSpillBudget)
+        Spill();
+}
+
+void SpillWriter::Spill() {
+    if (!spill_file_.is_open())
+        spill_file_.open(spill_file_name_, std::ios::in | std::ios::out | 
+                                           std::ios::trunc | std::ios::binary);
+    spill_file_.seekp(spill_file_len_, std::ios_base::beg);
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        BlockBuffer& block = blocks_[i];
+        if (block.bytes.size() > 0) {
+            spill_file_.write((const char*)&block.bytes[0], block.bytes.size());
+            Chunk chunk;
+            chunk.file_pos = spill_file_len_;
+            chunk.len = block.bytes.size();
+            block.chunks.push_back(chunk);
+            spill_file_len_ += chunk.len;
+            // Release the memory, otherwise the capacity of all the blocks adds up
+            std::vector<unsigned char>().swap(block.bytes);
         }
     }
+    buffered_bytes_ = 0;
+}
+
+void SpillWriter::CopyBlock(size_t block, ByteWriter* byte_writer, size_t target_block) {
+    BlockBuffer& buffer = blocks_[block];
+    std::vector<unsigned char> chunk_bytes;
+    for (size_t i = 0; i < buffer.chunks.size(); ++i) {
+        const Chunk& chunk = buffer.chunks[i];
+        chunk_bytes.resize(chunk.len);
+        spill_file_.seekg(chunk.file_pos, std::ios_base::beg);
+        spill_file_.read((char*)&chunk_bytes[0], chunk.len);
+        byte_writer->WriteBytes(&chunk_bytes[0], chunk.len, target_block);
+    }
+    if (buffer.bytes.size() > 0)
+        byte_writer->WriteBytes(&buffer.bytes[0], buffer.bytes.size(), target_block);
+    if (buffer.acc_len > 0)
+        byte_writer->WriteBits(buffer.acc, buffer.acc_len, target_block);
+    std::vector<unsigned char>().swap(buffer.bytes);
 }
 
+// The size of the read buffer if the file can not be memory mapped
+const size_t kReadBufferSize = 1 << 20;
+
 ByteReader::ByteReader(const std::string& file_name) :
-    fin_(file_name, std::ios::binary),
+    mapped_(NULL),
+    mapped_len_(0),
+    pos_(NULL),
+    end_(NULL),
     buffer_(0),
-    buffer_len_(0) {}
+    buffer_len_(0),
+    bit_pos_(0) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd >= 0 && fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) &&
+        file_stat.st_size > 0) {
+        void* addr = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            mapped_ = static_cast<unsigned char*>(addr);
+            mapped_len_ = file_stat.st_size;
+            // The file is read sequentially
+            madvise(addr, mapped_len_, MADV_SEQUENTIAL);
+            pos_ = mapped_;
+            end_ = mapped_ + mapped_len_;
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+    if (mapped_ == NULL) {
+        fin_.open(file_name, std::ios::binary);
+        read_buffer_.resize(kReadBufferSize);
+        pos_ = end_ = &read_buffer_[0];
+    }
+}
 
 ByteReader::~ByteReader() {
-    fin_.close();
+    if (mapped_ != NULL)
+        munmap(mapped_, mapped_len_);
+    else
+        fin_.close();
 }
 
-unsigned char ByteReader::ReadByte() {
-    if (buffer_len_ < 8) {
-        buffer_ = ((buffer_ << 8) | fin_.get());
-        buffer_len_ += 8;
+void ByteReader::LoadData() {
+    if (mapped_ != NULL || !fin_.is_open() || fin_.eof())
+        return;
+    size_t remain = end_ - pos_;
+    unsigned char* begin = &read_buffer_[0];
+    for (size_t i = 0; i < remain; ++i)
+        begin[i] = pos_[i];
+    fin_.read(reinterpret_cast<char*>(begin + remain), read_buffer_.size() - remain);
+    pos_ = begin;
+    end_ = begin + remain + fin_.gcount();
+}
+
+void ByteReader::FillBuffer(unsigned int len) {
+    if (buffer_len_ >= len)
+        return;
+    if (end_ - pos_ < 8)
+        LoadData();
+    // Take as many bytes as the buffer can hold
+    int bytes = (64 - buffer_len_) >> 3;
+    if (end_ - pos_ >= 8) {
+        unsigned long long word = 0;
+        for (int i = 0; i < 8; ++i)
+            word = (word << 8) | pos_[i];
+        if (bytes == 8)
+            buffer_ = word;
+        else
+            buffer_ = (buffer_ << (bytes << 3)) | (word >> (64 - (bytes << 3)));
+        pos_ += bytes;
+    } else {
+        for (int i = 0; i < bytes; ++i) {
+            unsigned char byte = (pos_ < end_ ? *(pos_ ++) : 0);
+            buffer_ = ((buffer_ << 8) | byte);
+        }
     }
+    buffer_len_ += (bytes << 3);
+}
+
+unsigned char ByteReader::ReadByte() {
+    FillBuffer(8);
     buffer_len_ -= 8;
+    bit_pos_ += 8;
     unsigned char ret = (buffer_ >> buffer_len_) & 0xff;
-    buffer_ ^= ret << buffer_len_;
+    buffer_ ^= (unsigned long long)ret << buffer_len_;
     return ret;
 }
 
 bool ByteReader::ReadBit() {
-    if (buffer_len_ == 0) {
-        buffer_ = ((buffer_ << 8) | fin_.get());
-        buffer_len_ += 8;
-    }
+    FillBuffer(1);
     -- buffer_len_;
+    ++ bit_pos_;
     bool ret = (buffer_ >> buffer_len_) & 1;
-    buffer_ ^= ret << buffer_len_;
+    buffer_ ^= (unsigned long long)ret << buffer_len_;
     return ret;
 }
 
 unsigned int ByteReader::Read16Bit() {
-    while (buffer_len_ < 16) {
-        buffer_ = ((buffer_ << 8) | fin_.get());
-        buffer_len_ += 8;
-    }
+    FillBuffer(16);
     buffer_len_ -= 16;
+    bit_pos_ += 16;
     unsigned int ret = (buffer_ >> buffer_len_) & 0xffff;
-    buffer_ ^= ret << buffer_len_;
+    buffer_ ^= (unsigned long long)ret << buffer_len_;
     return ret;
 }
 
 void ByteReader::Read32Bit(unsigned char* bytes) {
-    for (int i = 0; i < 4; ++i) {
-        if (buffer_len_ < 8) {
-            buffer_ = ((buffer_ << 8) | fin_.get());
-            buffer_len_ += 8;
-        }
-        buffer_len_ -= 8;
-        unsigned char ret = (buffer_ >> buffer_len_) & 0xff;
-        buffer_ ^= ret << buffer_len_;
-        bytes[i] = ret;
+    for (int i = 0; i < 4; ++i)
+        bytes[i] = ReadByte();
+}
+
+unsigned long long ByteReader::PeekBits(unsigned int len) {
+    FillBuffer(len);
+    return (buffer_ >> (buffer_len_ - len)) & ((1ULL << len) - 1);
+}
+
+void ByteReader::SkipBits(unsigned int len) {
+    FillBuffer(len);
+    buffer_len_ -= len;
+    bit_pos_ += len;
+    buffer_ &= (1ULL << buffer_len_) - 1;
+}
+
+unsigned long long ByteReader::ReadBits(unsigned int len) {
+    unsigned long long ret = PeekBits(len);
+    SkipBits(len);
+    return ret;
+}
+
+void ByteReader::Seek(unsigned long long bit_pos) {
+    size_t byte_pos = (bit_pos >> 3);
+    if (mapped_ != NULL) {
+        pos_ = mapped_ + (byte_pos < mapped_len_ ? byte_pos : mapped_len_);
+    } else {
+        fin_.clear();
+        fin_.seekg(byte_pos, std::ios_base::beg);
+        pos_ = end_ = &read_buffer_[0];
     }
+    buffer_ = 0;
+    buffer_len_ = 0;
+    bit_pos_ = (bit_pos & ~7ULL);
+    SkipBits(bit_pos & 7);
 }
 
 }  // namespace db_compress
@@ -13,40 +13,123 @@ namespace db_compress {
  * ByteWriter is a utility class that can be used to write bit strings.
  * The constructor takes a vector of integers indicating the (predetermined)
  * block lengths. Then the class provide interface to continue writing bit 
- * strings to any of these blocks in arbitrary order. Note that only if the
- * object is destoryed will the data be completely written into the file, 
- * otherwise some of the data might be held in memory buffer.
+ * strings to any of these blocks in arbitrary order. Each block collects its
+ * bytes in a memory buffer, the buffers are written to the file in large
+ * contiguous chunks once their total size exceeds the buffer budget. Note that
+ * only if the object is destoryed will the data be completely written into the
+ * file, otherwise some of the data might be held in memory buffer.
  */
 class ByteWriter {
   private:
-    // Since we can only write byte as a unit, sometimes we have unwritten
-    // prefix/suffix bis string that is shorter than 8 bits, we store them
-    // in the buffer.
-    std::vector<unsigned char> block_unwritten_prefix_;
-    std::vector<unsigned char> block_unwritten_suffix_;
-    // The starting point of incoming bit stream for each block
-    std::vector<size_t> block_pos_;
+    struct BlockBuffer {
+        // Completed bytes that have not been written to the file yet
+        std::vector<unsigned char> bytes;
+        // The file offset of the first byte of the block and the number of completed bytes
+        size_t start_pos, completed;
+        // Bits that do not form a complete byte yet, the accumulator initially holds
+        // zeros for the bits of the first byte which belong to the previous blocks
+        unsigned long long acc;
+        int acc_len;
+        // If the block does not start at byte boundary, its first byte is shared with
+        // the previous blocks, it is held in head until the destructor merges them
+        bool shared_head;
+        unsigned char head;
+    };
+    std::vector<BlockBuffer> blocks_;
+    size_t buffered_bytes_;
     std::ofstream file_;
+    size_t file_pos_;
+
+    inline void PushByte(BlockBuffer* block, unsigned char byte);
+    // Write the buffered bytes of all the blocks
+    void Flush();
+    void WriteAt(size_t pos, const unsigned char* bytes, size_t len);
   public:
     ByteWriter(std::vector<size_t>* block_length, const std::string& file_name);
     ~ByteWriter();
-    void WriteByte(unsigned char byte, size_t block);
+    // Only write the least significant (len) bits, len must not exceed 64
+    void WriteBits(unsigned long long bits, size_t len, size_t block);
+    void WriteByte(unsigned char byte, size_t block) { WriteBits(byte, 8, block); }
     // Only write the least significant (len) bits
-    void WriteLess(unsigned char byte, size_t len, size_t block);
+    void WriteLess(unsigned char byte, size_t len, size_t block) { WriteBits(byte, len, block); }
     // Write 16 bits at once
-    void Write16Bit(unsigned int val, size_t block);
+    void Write16Bit(unsigned int val, size_t block) { WriteBits(val, 16, block); }
     // Write 32 bits at once
     void Write32Bit(unsigned char byte[4], size_t block);
+    // Write len bytes at once
+    void WriteBytes(const unsigned char* bytes, size_t len, size_t block);
+};
+
+/*
+ * SpillWriter collects bit strings for a number of blocks whose lengths are not known
+ * in advance. The blocks are held in memory buffers, and are spilled to a temporary
+ * file in chunks once the total size of the buffers exceeds the spill budget. After
+ * all the bit strings are written, the blocks can be copied to a ByteWriter, whose
+ * block lengths are given by GetBlockLength. The temporary file is removed when the
+ * object is destroyed.
+ */
+class SpillWriter {
+  private:
+    struct Chunk {
+        unsigned long long file_pos;
+        size_t len;
+    };
+    struct BlockBuffer {
+        // Completed bytes that have not been spilled yet
+        std::vector<unsigned char> bytes;
+        // The spilled parts of the block in order
+        std::vector<Chunk> chunks;
+        // The total number of bits of the block
+        unsigned long long length;
+        // Bits that do not form a complete byte yet
+        unsigned long long acc;
+        int acc_len;
+    };
+    std::vector<BlockBuffer> blocks_;
+    size_t buffered_bytes_;
+    std::string spill_file_name_;
+    std::fstream spill_file_;
+    unsigned long long spill_file_len_;
+
+    // Write the buffered bytes of all the blocks to the temporary file
+    void Spill();
+  public:
+    SpillWriter(size_t num_of_blocks, const std::string& spill_file_name);
+    ~SpillWriter();
+    // Only write the least significant (len) bits, len must not exceed 64
+    void WriteBits(unsigned long long bits, size_t len, size_t block);
+    unsigned long long GetBlockLength(size_t block) const { return blocks_[block].length; }
+    // Write all the bits of block to the target block of byte_writer
+    void CopyBlock(size_t block, ByteWriter* byte_writer, size_t target_block);
 };
 
 /* 
  * ByteReader is a utility class that can be used to read bit strings.
- * It allows us to read in single bit at each time.
+ * It allows us to read in single bit at each time, or to peek at the
+ * upcoming bits and skip them later. Bits beyond the end of file are
+ * read as zeros. The file is memory mapped when possible, otherwise it
+ * is read through a large buffer. In both cases, the bit buffer is
+ * refilled 8 bytes at a time.
  */
 class ByteReader {
   private:
     std::ifstream fin_;
-    unsigned int buffer_, buffer_len_;
+    // The mapped file, NULL if the file is read through read_buffer_
+    unsigned char* mapped_;
+    size_t mapped_len_;
+    std::vector<unsigned char> read_buffer_;
+    // The unread bytes are [pos_, end_)
+    const unsigned char* pos_;
+    const unsigned char* end_;
+    unsigned long long buffer_;
+    unsigned int buffer_len_;
+    // The bit offset of the next bit to be read
+    unsigned long long bit_pos_;
+
+    // Move the unread bytes to the front of read_buffer_ and read more from the file
+    void LoadData();
+    // Make sure that the buffer holds at least len bits
+    void FillBuffer(unsigned int len);
   public:
     ByteReader(const std::string& file_name);
     ~ByteReader();
@@ -54,8 +137,26 @@ class ByteReader {
     bool ReadBit();
     unsigned int Read16Bit();
     void Read32Bit(unsigned char* bytes);
+    // Return the next len (at most 56) bits without consuming them
+    unsigned long long PeekBits(unsigned int len);
+    // Consume the next len (at most 56) bits
+    void SkipBits(unsigned int len);
+    // Read the next len (at most 56) bits
+    unsigned long long ReadBits(unsigned int len);
+    // Continue reading from the given bit offset of the file
+    void Seek(unsigned long long bit_pos);
+    // Return the bit offset of the next bit to be read
+    unsigned long long GetBitPosition() const { return bit_pos_; }
 };
 
+/*
+ * The file header holds a directory of segments, each segment consists of consecutive
+ * blocks and the directory records its starting bit offset and its number of tuples
+ * using the following bit widths.
+ */
+const int kSegmentOffsetBits = 48;
+const int kSegmentTuplesBits = 32;
+
 }  // namespace db_compress
 
 #endif
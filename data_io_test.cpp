@@ -35,6 +35,67 @@ void TestByteWriter() {
     }
 }
 
+void TestWriteBits() {
+    {
+        std::vector<size_t> blocks;
+        blocks.push_back(4);
+        blocks.push_back(2);
+        blocks.push_back(66);
+        ByteWriter writer(&blocks, "byte_writer_test.txt");
+        // We will write bit string 0x123456789abcdef012, blocks are interleaved
+        writer.WriteBits(0x8d159e26af37bc0ULL, 60, 2);
+        writer.WriteBits(1, 4, 0);
+        writer.WriteBits(0x12, 6, 2);
+        writer.WriteBits(0, 2, 1);
+    }
+    std::ifstream fin("byte_writer_test.txt", std::ios::binary);
+    unsigned char correct_answer[] = {0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0x12};
+    char c;
+    std::vector<unsigned char> file;
+    while (fin.get(c))
+        file.push_back((unsigned char)c);
+    if (file.size() != 9)
+        std::cerr << "ByteWriter WriteBits Unit Test Failed!\n";
+    for (size_t i = 0; i < 9 && i < file.size(); ++i)
+    if (file[i] != correct_answer[i])
+        std::cerr << "ByteWriter WriteBits Unit Test Failed!\n";
+}
+
+void TestSpillWriter() {
+    {
+        SpillWriter spill_writer(3, "byte_writer_test.txt.spill");
+        // Block 0: 0x12, block 1: 0x3456789abcdef, block 2: 0x012 (12 bits)
+        spill_writer.WriteBits(0x3, 2, 1);
+        spill_writer.WriteBits(0x1, 4, 0);
+        spill_writer.WriteBits(0x456789abcdefULL, 48, 1);
+        spill_writer.WriteBits(0x012, 12, 2);
+        spill_writer.WriteBits(0x2, 4, 0);
+        if (spill_writer.GetBlockLength(0) != 8 || spill_writer.GetBlockLength(1) != 50 ||
+            spill_writer.GetBlockLength(2) != 12)
+            std::cerr << "SpillWriter Unit Test Failed!\n";
+        std::vector<size_t> blocks;
+        blocks.push_back(8);
+        blocks.push_back(62);
+        ByteWriter writer(&blocks, "byte_writer_test.txt");
+        spill_writer.CopyBlock(2, &writer, 1);
+        spill_writer.CopyBlock(0, &writer, 0);
+        writer.WriteBits(0, 2, 1);
+        spill_writer.CopyBlock(1, &writer, 1);
+    }
+    // The bit string is 0x12, 0x012 (12 bits), 00, 0x3456789abcdef (50 bits)
+    std::ifstream fin("byte_writer_test.txt", std::ios::binary);
+    unsigned char correct_answer[] = {0x12, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef};
+    char c;
+    std::vector<unsigned char> file;
+    while (fin.get(c))
+        file.push_back((unsigned char)c);
+    if (file.size() != 9)
+        std::cerr << "SpillWriter Unit Test Failed!\n";
+    for (size_t i = 0; i < 9 && i < file.size(); ++i)
+    if (file[i] != correct_answer[i])
+        std::cerr << "SpillWriter Unit Test Failed!\n";
+}
+
 void TestByteReader() {
     {
         std::vector<size_t> blocks;
@@ -71,10 +132,23 @@ void TestByteReader() {
     reader.Read32Bit(bytes);
     if (bytes[0] != 0xef || bytes[1] != 0x01 || bytes[2] != 0x23 || bytes[3] != 0x45)
         std::cerr << "Byte Reader Unit Test Failed!\n";
+
+    ByteReader another_reader("byte_writer_test.txt");
+    if (another_reader.PeekBits(12) != 0x123 || another_reader.PeekBits(40) != 0x123456789aULL)
+        std::cerr << "Byte Reader Unit Test Failed!\n";
+    another_reader.SkipBits(12);
+    if (another_reader.ReadBit() != 0 || another_reader.PeekBits(3) != 0x4)
+        std::cerr << "Byte Reader Unit Test Failed!\n";
+    another_reader.SkipBits(51);
+    // Bits beyond the end of file are zeros
+    if (another_reader.PeekBits(24) != 0x123450)
+        std::cerr << "Byte Reader Unit Test Failed!\n";
 }
 
 void Test() {
     TestByteWriter();
+    TestWriteBits();
+    TestSpillWriter();
     TestByteReader();
 }
 
@@ -1,7 +1,11 @@
 #include "base.h"
 #include "decompression.h"
+#include "utility.h"
 
+#include <algorithm>
 #include <fstream>
+#include <iostream>
+#include <mutex>
 #include <vector>
 
 namespace db_compress {
@@ -16,28 +20,120 @@ SquIDModel* GetModelFromDescription(ByteReader* byte_reader, const Schema& schem
     return ret;
 }
 
+// The default number of segments whose tuple positions are kept
+const size_t kDefaultCacheCapacity = 16;
+
 }  // anonymous namespace
 
 Decompressor::Decompressor(const char* compressedFileName, const Schema& schema) : 
     byte_reader_(compressedFileName),
+    cache_capacity_(kDefaultCacheCapacity),
     schema_(schema) {
 }
 
 void Decompressor::Init() {
     implicit_length_ = byte_reader_.ReadByte();
+    segment_length_ = byte_reader_.ReadByte();
     for (size_t i = 0; i < schema_.attr_type.size(); ++ i) {
         attr_order_.push_back(byte_reader_.Read16Bit());
     }
+    segment_first_tuple_.push_back(0);
+    for (size_t i = 0; i < ((size_t)1 << segment_length_); ++ i) {
+        segment_offset_.push_back(byte_reader_.ReadBits(kSegmentOffsetBits));
+        segment_tuples_.push_back(byte_reader_.ReadBits(kSegmentTuplesBits));
+        segment_first_tuple_.push_back(segment_first_tuple_.back() + segment_tuples_.back());
+    }
     for (size_t i = 0; i < schema_.attr_type.size(); ++ i) {
-        std::unique_ptr<SquIDModel> model(GetModelFromDescription(&byte_reader_, schema_, i));
-        model_.push_back(std::move(model));
+        std::shared_ptr<const SquIDModel> model(GetModelFromDescription(&byte_reader_, schema_, i));
+        model_.push_back(model);
     }
+    CreateContexts();
     implicit_prefix_ = 0;
+    end_prefix_ = ((size_t)1 << implicit_length_);
+    ReadTuplePrefix();
+}
+
+void Decompressor::Init(const Decompressor& other) {
+    implicit_length_ = other.implicit_length_;
+    segment_length_ = other.segment_length_;
+    attr_order_ = other.attr_order_;
+    segment_offset_ = other.segment_offset_;
+    segment_tuples_ = other.segment_tuples_;
+    segment_first_tuple_ = other.segment_first_tuple_;
+    model_ = other.model_;
+    CreateContexts();
+    // The first segment starts right after the models
+    byte_reader_.Seek(segment_offset_[0]);
+    implicit_prefix_ = 0;
+    end_prefix_ = ((size_t)1 << implicit_length_);
+    ReadTuplePrefix();
+}
+
+void Decompressor::CreateContexts() {
+    context_.clear();
+    for (size_t i = 0; i < model_.size(); ++ i)
+        context_.push_back(std::unique_ptr<SquIDContext>(new SquIDContext(*model_[i])));
+}
+
+void Decompressor::SeekSegment(size_t segment) {
+    size_t blocks_per_segment = ((size_t)1 << (implicit_length_ - segment_length_));
+    byte_reader_.Seek(segment_offset_[segment]);
+    implicit_prefix_ = segment * blocks_per_segment;
+    end_prefix_ = implicit_prefix_ + blocks_per_segment;
     ReadTuplePrefix();
 }
 
+const std::vector<Decompressor::TuplePosition>& 
+        Decompressor::GetTuplePositions(size_t segment) {
+    for (auto it = position_cache_.begin(); it != position_cache_.end(); ++it)
+    if (it->first == segment) {
+        position_cache_.splice(position_cache_.begin(), position_cache_, it);
+        return it->second;
+    }
+    position_cache_.push_front(std::make_pair(segment, std::vector<TuplePosition>()));
+    std::vector<TuplePosition>& positions = position_cache_.front().second;
+    SeekSegment(segment);
+    Tuple tuple(schema_.attr_type.size());
+    while (HasNext()) {
+        TuplePosition position;
+        position.bit_pos = byte_reader_.GetBitPosition();
+        position.implicit_prefix = implicit_prefix_;
+        positions.push_back(position);
+        ReadNextTuple(&tuple);
+    }
+    if (position_cache_.size() > cache_capacity_)
+        position_cache_.pop_back();
+    return positions;
+}
+
+void Decompressor::SeekTuple(size_t n) {
+    if (n >= GetNumOfTuples()) {
+        implicit_prefix_ = end_prefix_ = ((size_t)1 << implicit_length_);
+        return;
+    }
+    size_t segment = std::upper_bound(segment_first_tuple_.begin(),
+                                      segment_first_tuple_.end(), n) 
+                     - segment_first_tuple_.begin() - 1;
+    const std::vector<TuplePosition>& positions = GetTuplePositions(segment);
+    size_t index = n - segment_first_tuple_[segment];
+    end_prefix_ = ((size_t)1 << implicit_length_);
+    if (index >= positions.size()) {
+        std::cerr << "Corrupted Compressed File\n";
+        implicit_prefix_ = end_prefix_;
+        return;
+    }
+    byte_reader_.Seek(positions[index].bit_pos);
+    implicit_prefix_ = positions[index].implicit_prefix;
+}
+
+void Decompressor::SetCacheCapacity(size_t capacity) {
+    cache_capacity_ = (capacity < 1 ? 1 : capacity);
+    while (position_cache_.size() > cache_capacity_)
+        position_cache_.pop_back();
+}
+
 void Decompressor::ReadTuplePrefix() {
-    while (implicit_prefix_ < ((unsigned)1 << implicit_length_)) {
+    while (implicit_prefix_ < end_prefix_) {
         bool bit = byte_reader_.ReadBit();
         if (bit) 
             ++ implicit_prefix_;
@@ -46,33 +142,104 @@ void Decompressor::ReadTuplePrefix() {
     }
 }
 
+/*
+ * Bits are peeked from byte_reader_ and fed into the RangeDecoder as many as possible at
+ * once, they are only consumed from byte_reader_ once the RangeDecoder knows that they
+ * belong to the current tuple. pending_bits is the number of bits that have been fed but
+ * not yet consumed.
+ */
+void Decompressor::ConsumeBits(const RangeDecoder& range_decoder, int* pending_bits) {
+    int surplus_bits = range_decoder.GetSurplusBits();
+    if (surplus_bits < *pending_bits) {
+        byte_reader_.SkipBits(*pending_bits - surplus_bits);
+        *pending_bits = surplus_bits;
+    }
+}
+
 void Decompressor::ReadNextTuple(Tuple* tuple) {
-    unsigned int implicit_prefix_count_ = 1;
-    ProbInterval PIt(GetZeroProb(), GetOneProb());
-    UnitProbInterval PIb = GetWholeProbInterval();
+    RangeDecoder range_decoder;
+    range_decoder.FeedBits(implicit_prefix_, implicit_length_);
+    int pending_bits = 0;
     for (size_t i = 0; i < schema_.attr_type.size(); ++i) {
-        Decoder* decoder = model_[attr_order_[i]]->GetDecoder(*tuple, PIt, PIb);
+        size_t attr_index = attr_order_[i];
+        Decoder* decoder = model_[attr_index]->GetDecoder(*tuple, &range_decoder,
+                                                          context_[attr_index].get());
         while (!decoder->IsEnd()) {
-            bool bit;
-            if (implicit_prefix_count_ <= implicit_length_) {
-                bit = ((implicit_prefix_ >> (implicit_length_ - implicit_prefix_count_)) & 1); 
-                ++ implicit_prefix_count_;
-            } else
-                bit = byte_reader_.ReadBit();
-            decoder->FeedBit(bit);
+            ConsumeBits(range_decoder, &pending_bits);
+            int len = range_decoder.GetFreeBits();
+            if (len == 0) {
+                std::cerr << "Corrupted Compressed File\n";
+                return;
+            }
+            unsigned long long bits = byte_reader_.PeekBits(pending_bits + len);
+            decoder->FeedBits(bits & ((1ULL << len) - 1), len);
+            pending_bits += len;
         }
-        PIt = decoder->GetPIt();
-        PIb = decoder->GetPIb();
         const AttrValue* result = decoder->GetResult();
-        tuple->attr[attr_order_[i]] = result;
+        tuple->attr[attr_index] = result;
     }
+    ConsumeBits(range_decoder, &pending_bits);
     // We read the prefix for next tuple after finish reading the current tuple,
     // this helps us to determine the end of file
     ReadTuplePrefix();
 }
 
 bool Decompressor::HasNext() const {
-    return (implicit_prefix_ < ((unsigned)1 << implicit_length_)); 
+    return (implicit_prefix_ < end_prefix_); 
+}
+
+ParallelDecompressor::ParallelDecompressor(const char* compressedFileName,
+                                           const Schema& schema, int num_of_threads) :
+    file_name_(compressedFileName),
+    schema_(schema),
+    decompressor_(num_of_threads < 1 ? 1 : num_of_threads) {
+    // The first decompressor reads the block directory, the others are created lazily
+    decompressor_[0].reset(new Decompressor(compressedFileName, schema));
+    decompressor_[0]->Init();
+}
+
+void ParallelDecompressor::DecodeSegment(int worker, size_t segment,
+                                         const TupleHandler& handler) {
+    if (decompressor_[worker] == NULL) {
+        decompressor_[worker].reset(new Decompressor(file_name_.c_str(), schema_));
+        decompressor_[worker]->Init(*decompressor_[0]);
+    }
+    Decompressor* decompressor = decompressor_[worker].get();
+    decompressor->SeekSegment(segment);
+    Tuple tuple(schema_.attr_type.size());
+    while (decompressor->HasNext()) {
+        decompressor->ReadNextTuple(&tuple);
+        handler(segment, tuple);
+    }
+}
+
+void ParallelDecompressor::Run(const TupleHandler& handler) {
+    ParallelFor(GetNumOfSegments(), decompressor_.size(), [&](int worker, size_t segment) {
+        DecodeSegment(worker, segment, handler);
+    });
+}
+
+/*
+ * Since segments are handed out in increasing order, only the segments being decoded
+ * and the finished segments waiting for their predecessors are held in memory.
+ */
+void ParallelDecompressor::Run(const TupleFormatter& formatter, std::ostream* out) {
+    std::vector<std::string> output(GetNumOfSegments());
+    std::vector<bool> finished(GetNumOfSegments(), false);
+    size_t next_segment = 0;
+    std::mutex mutex;
+    ParallelFor(GetNumOfSegments(), decompressor_.size(), [&](int worker, size_t segment) {
+        DecodeSegment(worker, segment, [&](size_t segment, const Tuple& tuple) {
+            formatter(tuple, &output[segment]);
+        });
+        std::lock_guard<std::mutex> lock(mutex);
+        finished[segment] = true;
+        while (next_segment < finished.size() && finished[next_segment]) {
+            out->write(output[next_segment].data(), output[next_segment].size());
+            std::string().swap(output[next_segment]);
+            ++ next_segment;
+        }
+    });
 }
 
 }  // namespace db_compress
@@ -8,26 +8,96 @@
 #include "data_io.h"
 
 #include <fstream>
+#include <functional>
+#include <list>
 #include <string>
 #include <memory>
 #include <vector>
 
 namespace db_compress {
 
+/*
+ * Decompressor reads the tuples of the whole file in order after Init(). Alternatively,
+ * SeekSegment() restricts the reading to one of the segments listed in the block
+ * directory, so that different segments can be read independently, and SeekTuple()
+ * continues reading from any tuple. The positions of the tuples are collected by
+ * decoding the whole segment once, and are kept for the recently used segments.
+ */
 class Decompressor {
   private:
+    struct TuplePosition {
+        unsigned long long bit_pos;
+        size_t implicit_prefix;
+    };
+
     ByteReader byte_reader_;
     size_t implicit_length_, implicit_prefix_;
+    // Reading stops when implicit_prefix_ reaches end_prefix_
+    size_t end_prefix_;
+    size_t segment_length_;
+    std::vector<unsigned long long> segment_offset_;
+    std::vector<size_t> segment_tuples_;
+    // The index of the first tuple of each segment, plus the total number of tuples
+    std::vector<size_t> segment_first_tuple_;
+    // The tuple positions of the recently used segments, the most recent one first
+    std::list< std::pair<size_t, std::vector<TuplePosition> > > position_cache_;
+    size_t cache_capacity_;
     Schema schema_;
-    std::vector< std::unique_ptr<SquIDModel> > model_;
+    // The models can be shared with other decompressors of the same file, while the
+    // contexts are owned by this decompressor
+    std::vector< std::shared_ptr<const SquIDModel> > model_;
+    std::vector< std::unique_ptr<SquIDContext> > context_;
     std::vector<size_t> attr_order_;
 
+    void CreateContexts();
     void ReadTuplePrefix();
+    void ConsumeBits(const RangeDecoder& range_decoder, int* pending_bits);
+    const std::vector<TuplePosition>& GetTuplePositions(size_t segment);
   public:
     Decompressor(const char* compressedFileName, const Schema& schema);
     void Init();
+    // Same as Init(), but shares the block directory and the models with another
+    // initialized decompressor of the same file instead of reading them again
+    void Init(const Decompressor& other);
     void ReadNextTuple(Tuple* tuple);
     bool HasNext() const;
+
+    size_t GetNumOfSegments() const { return segment_tuples_.size(); }
+    size_t GetNumOfTuples(size_t segment) const { return segment_tuples_[segment]; }
+    size_t GetNumOfTuples() const { return segment_first_tuple_.back(); }
+    // Only read the tuples of the given segment from now on
+    void SeekSegment(size_t segment);
+    // Read from the n-th tuple (in the order of the file) to the end of file
+    void SeekTuple(size_t n);
+    // The maximum number of segments whose tuple positions are kept
+    void SetCacheCapacity(size_t capacity);
+};
+
+/*
+ * ParallelDecompressor decodes the segments of the file concurrently on a number of
+ * threads. Each thread owns a Decompressor, all of which share the models read by the
+ * first one. Segments are handed out in increasing order.
+ */
+class ParallelDecompressor {
+  public:
+    // The tuple is only valid during the call, which can be made from any of the threads
+    typedef std::function<void(size_t segment, const Tuple& tuple)> TupleHandler;
+    // Append the representation of the tuple to the string
+    typedef std::function<void(const Tuple& tuple, std::string* str)> TupleFormatter;
+
+    ParallelDecompressor(const char* compressedFileName, const Schema& schema,
+                         int num_of_threads);
+    size_t GetNumOfSegments() const { return decompressor_[0]->GetNumOfSegments(); }
+    // Hand out the tuples of each segment in order, segments are handled concurrently
+    void Run(const TupleHandler& handler);
+    // Format the tuples concurrently and write them to out in the original order
+    void Run(const TupleFormatter& formatter, std::ostream* out);
+  private:
+    std::string file_name_;
+    Schema schema_;
+    std::vector< std::unique_ptr<Decompressor> > decompressor_;
+
+    void DecodeSegment(int worker, size_t segment, const TupleHandler& handler);
 };
 
 }  // namespace db_compress
@@ -15,8 +15,8 @@ void PrepareData() {
     std::vector<int> schema_; schema_.push_back(0); schema_.push_back(0);
     schema = Schema(schema_);
     std::ofstream fout("compression_test.txt");
-    unsigned char data[] = {1,0,0,0,1,0,2,0,2,0x5c};
-    for (int i = 0; i < 10; ++i )
+    unsigned char data[] = {1,0,0,0,0,1,0,0,0,0,0,0xa0,0,0,0,2,0,2,0,2,0x5c};
+    for (int i = 0; i < 21; ++i )
         fout << data[i];
     fout.close();
 }
@@ -37,9 +37,31 @@ void TestDecompression() {
         std::cerr << "Decompression Unit Test Failed!\n";
 }
 
+void TestSeekSegment() {
+    Decompressor decompressor("compression_test.txt", schema);
+    decompressor.Init();
+    if (decompressor.GetNumOfSegments() != 1 || decompressor.GetNumOfTuples(0) != 2)
+        std::cerr << "Decompression Seek Unit Test Failed!\n";
+    Tuple tuple(2);
+    decompressor.ReadNextTuple(&tuple);
+    // Seeking restarts the segment from its first tuple
+    decompressor.SeekSegment(0);
+    for (int i = 0; i < 2; ++i) {
+        if (!decompressor.HasNext())
+            std::cerr << "Decompression Seek Unit Test Failed!\n";
+        decompressor.ReadNextTuple(&tuple);
+        if (static_cast<const MockAttr*>(tuple.attr[0])->Val() != 0 ||
+            static_cast<const MockAttr*>(tuple.attr[1])->Val() != 1)
+            std::cerr << "Decompression Seek Unit Test Failed!\n";
+    }
+    if (decompressor.HasNext())
+        std::cerr << "Decompression Seek Unit Test Failed!\n";
+}
+
 void Test() {
     PrepareData();
     TestDecompression();
+    TestSeekSegment();
 }
 
 }  // namespace db_compress
@@ -41,6 +41,8 @@ void SetConfig() {
     schema = db_compress::Schema(type);
     config.allowed_err = err;
     config.sort_by_attr = 0;
+    // The learning passes are cut short at NonFullPassStopPoint
+    config.allow_partial_passes = true;
 }
 
 inline void AppendAttr(double attr, db_compress::Tuple* tuple, int index) {
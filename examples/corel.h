@@ -18,12 +18,14 @@ class ColorSquID: public db_compress::SquID {
   private:
     bool first_step_, is_zero_;
     db_compress::Prob zero_prob_;
-    db_compress::LaplaceSquID* tree_;
+    std::unique_ptr<db_compress::SquID> tree_;
 
     ColorAttr attr_;
   public:
-    ColorSquID(db_compress::Prob zero_prob, 
-                  db_compress::LaplaceSquID* tree);
+    // Takes ownership of the tree
+    ColorSquID(db_compress::SquID* tree);
+    void Init(db_compress::Prob zero_prob);
+    db_compress::SquID* GetTree() { return tree_.get(); }
     bool HasNextBranch() const;
     void GenerateNextBranch();
     int GetNextBranch(const db_compress::AttrValue* attr) const;
@@ -34,17 +36,18 @@ class ColorSquID: public db_compress::SquID {
 class ColorModel: public db_compress::SquIDModel {
   private:
     std::unique_ptr<db_compress::SquIDModel> numeric_model_;
-    std::unique_ptr<ColorSquID> squid_;
     size_t zero_count_, non_zero_count_;
     int model_cost_;
     db_compress::Prob zero_prob_;
   public:
     ColorModel(const db_compress::Schema& schema, const std::vector<size_t>& predictors, 
                size_t target_var, double err);
-    db_compress::SquID* GetSquID(const db_compress::Tuple& tuple);
+    db_compress::SquID* CreateSquID() const;
+    void InitSquID(const db_compress::Tuple& tuple, db_compress::SquID* squid) const;
     int GetModelCost() const { return model_cost_; }
     void FeedTuple(const db_compress::Tuple& tuple);
     void EndOfData();
+    void Merge(const db_compress::SquIDModel& model);
 
     int GetModelDescriptionLength() const;
     void WriteModel(db_compress::ByteWriter* byte_writer, size_t block_index) const;
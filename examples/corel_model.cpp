@@ -6,14 +6,18 @@
 #include <memory>
 #include <vector>
 
-ColorSquID::ColorSquID(db_compress::Prob zero_prob,
-                       db_compress::LaplaceSquID* tree) :
+ColorSquID::ColorSquID(db_compress::SquID* tree) :
     first_step_(true),
     is_zero_(false),
-    zero_prob_(zero_prob),
     tree_(tree),
     attr_(0) {}
 
+void ColorSquID::Init(db_compress::Prob zero_prob) {
+    first_step_ = true;
+    is_zero_ = false;
+    zero_prob_ = zero_prob;
+}
+
 bool ColorSquID::HasNextBranch() const {
     if (first_step_)
         return true;
@@ -25,8 +29,7 @@ bool ColorSquID::HasNextBranch() const {
 
 void ColorSquID::GenerateNextBranch() {
     if (first_step_) {
-        prob_segs_.clear();
-        prob_segs_.push_back(zero_prob_);
+        prob_segs_ = db_compress::ProbSegs(&zero_prob_, 1);
     } else {
         tree_->GenerateNextBranch();
         prob_segs_ = tree_->GetProbSegs();
@@ -74,11 +77,14 @@ ColorModel::ColorModel(const db_compress::Schema& schema, const std::vector<size
     non_zero_count_(0),
     model_cost_(0) {}
 
-db_compress::SquID* ColorModel::GetSquID(const db_compress::Tuple& tuple) {
-    db_compress::LaplaceSquID* tree_ = 
-        static_cast<db_compress::LaplaceSquID*>(numeric_model_->GetSquID(tuple));
-    squid_.reset(new ColorSquID(zero_prob_, tree_));
-    return squid_.get();
+db_compress::SquID* ColorModel::CreateSquID() const {
+    return new ColorSquID(numeric_model_->CreateSquID());
+}
+
+void ColorModel::InitSquID(const db_compress::Tuple& tuple, db_compress::SquID* squid) const {
+    ColorSquID* color_squid = static_cast<ColorSquID*>(squid);
+    numeric_model_->InitSquID(tuple, color_squid->GetTree());
+    color_squid->Init(zero_prob_);
 }
 
 void ColorModel::FeedTuple(const db_compress::Tuple& tuple) {
@@ -91,6 +97,13 @@ void ColorModel::FeedTuple(const db_compress::Tuple& tuple) {
     }
 }
 
+void ColorModel::Merge(const db_compress::SquIDModel& model) {
+    const ColorModel& other = static_cast<const ColorModel&>(model);
+    zero_count_ += other.zero_count_;
+    non_zero_count_ += other.non_zero_count_;
+    numeric_model_->Merge(*other.numeric_model_);
+}
+
 void ColorModel::EndOfData() {
     numeric_model_->EndOfData();
 
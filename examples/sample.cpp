@@ -24,7 +24,8 @@ class SimpleCategoricalInterpreter: public db_compress::AttrInterpreter {
     }
 };
 
-const int NonFullPassStopPoint = 2000;
+// The model structure is learned on a uniform sample of this many tuples
+const size_t SampleSize = 2000;
 
 char inputFileName[100], outputFileName[100], configFileName[100];
 bool compress;
@@ -78,22 +79,33 @@ void ReadConfig(char* configFileName) {
             type.push_back(type_);
             if (vec[0] == "ENUM") {
                 RegisterAttrModel(type_, new db_compress::TableCategoricalCreator());
+                RegisterAttrModel(type_, new db_compress::SparseTableCategoricalCreator());
                 RegisterAttrInterpreter(type_, new SimpleCategoricalInterpreter(std::stoi(vec[1])));
+                RegisterAttrVector(type_, 
+                    &db_compress::CreateTypedAttrVector<db_compress::EnumAttrValue>);
                 err.push_back(std::stod(vec[2]));
                 attr_type.push_back(0);
             } else if (vec[0] == "INTEGER") {
                 RegisterAttrModel(type_, new db_compress::TableLaplaceIntCreator());
+                RegisterAttrModel(type_, new db_compress::SparseTableLaplaceIntCreator());
                 RegisterAttrInterpreter(type_, new db_compress::AttrInterpreter());
+                RegisterAttrVector(type_, 
+                    &db_compress::CreateTypedAttrVector<db_compress::IntegerAttrValue>);
                 err.push_back(std::stod(vec[1]));
                 attr_type.push_back(1);
             } else if (vec[0] == "DOUBLE") {
                 RegisterAttrModel(type_, new db_compress::TableLaplaceRealCreator());
+                RegisterAttrModel(type_, new db_compress::SparseTableLaplaceRealCreator());
                 RegisterAttrInterpreter(type_, new db_compress::AttrInterpreter());
+                RegisterAttrVector(type_, 
+                    &db_compress::CreateTypedAttrVector<db_compress::DoubleAttrValue>);
                 err.push_back(std::stod(vec[1]));
                 attr_type.push_back(2);
             } else if (vec[0] == "STRING") {
                 RegisterAttrModel(type_, new db_compress::StringModelCreator());
                 RegisterAttrInterpreter(type_, new db_compress::AttrInterpreter());
+                RegisterAttrVector(type_, 
+                    &db_compress::CreateTypedAttrVector<db_compress::StringAttrValue>);
                 err.push_back(0);
                 attr_type.push_back(3);
             } else
@@ -105,6 +117,7 @@ void ReadConfig(char* configFileName) {
         std::cerr << "Config File Error!\n";
     schema = db_compress::Schema(type);
     config.allowed_err = err;
+    config.sample_size = SampleSize;
 
     enum_vec.resize(attr_type.size());
     int_vec.resize(attr_type.size());
@@ -171,7 +184,6 @@ int main(int argc, char **argv) {
                 std::cout << "Iteration " << ++iter_cnt << " Starts\n";
                 std::ifstream inFile(inputFileName);
                 std::string str;
-                int tuple_cnt = 0;
                 while (std::getline(inFile,str)) {
                     std::stringstream sstream(str);
                     std::string item;
@@ -191,10 +203,6 @@ int main(int argc, char **argv) {
                         std::cerr << "File Format Error!\n";
                     }
                     compressor.ReadTuple(tuple);
-                    if (!compressor.RequireFullPass() && 
-                        ++ tuple_cnt >= NonFullPassStopPoint) {
-                        break;
-                    }
                 }
                 compressor.EndOfData();
                 if (!compressor.RequireMoreIterations()) 
@@ -2,6 +2,7 @@
 
 #include "base.h"
 
+#include <iostream>
 #include <vector>
 #include <map>
 #include <memory>
@@ -9,6 +10,11 @@
 namespace db_compress {
 
 namespace {
+    // Decode costs in the unit of one SquID branch
+    const double kPredictorCost = 0.25;
+    const double kCacheMissCost = 2;
+    const size_t kCacheBytes = 32 << 10;
+
     std::map<int, std::vector<std::unique_ptr<ModelCreator> > > model_rep;
     /* 
      * model_ptr is the replicate of model_rep, but without being unique_ptr
@@ -16,6 +22,7 @@ namespace {
      */
     std::map<int, std::vector<ModelCreator*> > model_ptr;
     std::map<int, std::unique_ptr<AttrInterpreter> > interpreter_rep;
+    std::map<int, AttrVectorFactory> vector_rep;
 }  // anonymous namespace
 
 void RegisterAttrModel(int attr_type, ModelCreator* creator) {
@@ -38,38 +45,31 @@ const AttrInterpreter* GetAttrInterpreter(int attr_type) {
     return interpreter_rep[attr_type].get();
 }
 
-// We have to explicitly define this because PIt and PIb do not have default constructor,
+void RegisterAttrVector(int attr_type, AttrVectorFactory factory) {
+    vector_rep[attr_type] = factory;
+}
+
+AttrVector* CreateAttrVector(int attr_type) {
+    auto it = vector_rep.find(attr_type);
+    if (it == vector_rep.end())
+        return NULL;
+    return it->second();
+}
+
 Decoder::Decoder() :
-    PIt_(Prob(), Prob()),
-    PIb_(0,0) {}
+    squid_(NULL),
+    range_decoder_(NULL) {}
 
-inline void Decoder::Init(SquID* squid, const ProbInterval& PIt,
-                          const UnitProbInterval& PIb) {
+void Decoder::Init(SquID* squid, RangeDecoder* range_decoder) {
     squid_ = squid;
-    PIt_ = PIt;
-    PIb_ = PIb;
+    range_decoder_ = range_decoder;
     if (NextBranch()) 
         Advance();
 }
 
-void Decoder::NextBoundary() {
-    if (l_ == r_) {
-        ProbInterval sub = squid_->GetProbInterval(l_);
-        PIt_ = GetPIProduct(PIt_, sub, &bytes_);
-    } else {
-        mid_ = (l_ + r_) / 2;
-        boundary_ = GetPIRatioPoint(PIt_, squid_->GetProbSegs()[mid_]);
-    }
-}
-
 bool Decoder::NextBranch() {
     if (squid_->HasNextBranch()) {
         squid_->GenerateNextBranch();
-        l_ = 0;
-        r_ = squid_->GetProbSegs().size();
-        mid_ = (l_ + r_) / 2;
-        if (l_ != r_)
-            boundary_ = GetPIRatioPoint(PIt_, squid_->GetProbSegs()[mid_]);
         return true;
     }
     return false;
@@ -79,15 +79,32 @@ SquIDModel::SquIDModel(const std::vector<size_t>& predictors, size_t target_var)
     predictor_list_(predictors),
     target_var_(target_var) {}
 
-Decoder* SquIDModel::GetDecoder(const Tuple& tuple, const ProbInterval& PIt,
-                           const UnitProbInterval& PIb) {
-    decoder_.Init(GetSquID(tuple), PIt, PIb);
-    return &decoder_;
+void SquIDModel::Merge(const SquIDModel& model) {
+    std::cerr << "Model Merging Not Supported\n";
+}
+
+double GetTableLookupCost(size_t num_of_predictors, size_t table_bytes) {
+    double cost = num_of_predictors * kPredictorCost;
+    if (table_bytes > kCacheBytes)
+        cost += (1 - (double)kCacheBytes / table_bytes) * kCacheMissCost;
+    return cost;
+}
+
+SquID* SquIDModel::GetSquID(const Tuple& tuple, SquIDContext* context) const {
+    InitSquID(tuple, context->GetSquID());
+    return context->GetSquID();
+}
+
+Decoder* SquIDModel::GetDecoder(const Tuple& tuple, RangeDecoder* range_decoder,
+                                SquIDContext* context) const {
+    context->GetDecoder()->Init(GetSquID(tuple, context), range_decoder);
+    return context->GetDecoder();
 }
 
-void SquIDModel::GetProbInterval(const Tuple& tuple, std::vector<ProbInterval>* prob_intervals,
-                            const AttrValue** result_attr) {
-    SquID* squid = GetSquID(tuple);
+void SquIDModel::GetProbInterval(const Tuple& tuple, SquIDContext* context,
+                                 std::vector<ProbInterval>* prob_intervals,
+                                 const AttrValue** result_attr) const {
+    SquID* squid = GetSquID(tuple, context);
     while (squid->HasNextBranch()) {
         squid->GenerateNextBranch();
         int branch = squid->GetNextBranch(tuple.attr[target_var_]);
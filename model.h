@@ -7,8 +7,10 @@
 
 #include "base.h"
 #include "data_io.h"
+#include "range_coder.h"
 #include "utility.h"
 
+#include <cstdint>
 #include <vector>
 #include <set>
 #include <map>
@@ -19,12 +21,21 @@ namespace db_compress {
 /*
  * The SquID class defines the interface of branching, which can be used in
  * encoding & decoding. This interface simplifies the process of defining models
- * for new attributes
+ * for new attributes. The probability segment boundaries are quantized to multiples of
+ * 2^-kProbBits (2^-16) by the range coder, hence every branch that may be taken must
+ * remain at least 2^-16 wide after the quantization, e.g., a branch of GetProb(1, 20)
+ * can not be encoded.
  */
 class SquID {
   protected:
-    std::vector<Prob> prob_segs_;
+    // The probability segments of the next branch, which view either the tables of the
+    // model or the storage of the subclass, so that no boundaries are copied per branch
+    ProbSegs prob_segs_;
+    // Optional inverse CDF table of prob_segs_, which is used to accelerate decoding.
+    // The subclasses setting this pointer must keep it consistent with prob_segs_.
+    const InverseCDFTable* inverse_cdf_;
   public:
+    SquID() : inverse_cdf_(NULL) {}
     virtual ~SquID() = 0;
     // Return false if reached leave node
     virtual bool HasNextBranch() const = 0;
@@ -37,7 +48,8 @@ class SquID {
     // Return result attribute value, do not transfer ownership
     virtual const AttrValue* GetResultAttr() = 0;
 
-    const std::vector<Prob>& GetProbSegs() const { return prob_segs_; }
+    ProbSegs GetProbSegs() const { return prob_segs_; }
+    const InverseCDFTable* GetInverseCDF() const { return inverse_cdf_; }
     ProbInterval GetProbInterval(int branch) const;
 };
 
@@ -53,88 +65,101 @@ inline ProbInterval SquID::GetProbInterval(int branch) const {
 }
 
 /*
- * Decoder Class is initialized with two ProbIntervals and one SquID instance,
- * it reads in bits from input stream, determines the next branch until reaching
- * a leaf node of the SquID, and then emits the result and two reduced ProbIntervals.
+ * Decoder Class is initialized with one SquID instance and the RangeDecoder which holds
+ * the decoding state of current tuple, it reads in bits from input stream, determines the
+ * next branch until reaching a leaf node of the SquID, and then emits the result. The
+ * RangeDecoder can then be passed to the Decoder of next attribute.
  */
 class Decoder {
   private:
     SquID* squid_;
-    size_t l_, r_, mid_;
-    ProbInterval PIt_;
-    UnitProbInterval PIb_;
-    std::vector<unsigned char> bytes_;
-    Prob boundary_;
+    RangeDecoder* range_decoder_;
 
     void Advance();
-    void NextBoundary();
     bool NextBranch();
   public:
     Decoder();
-    void Init(SquID* squid, const ProbInterval& PIt, const UnitProbInterval& PIb);
+    void Init(SquID* squid, RangeDecoder* range_decoder);
     bool IsEnd() const { return !squid_->HasNextBranch(); }
     void FeedBit(bool bit);
-    ProbInterval GetPIt() const { return PIt_; }
-    UnitProbInterval GetPIb() const { return PIb_; }
+    // Feed len bits at once, len must not exceed the free bits of the RangeDecoder
+    void FeedBits(unsigned long long bits, int len);
     // Do not transfer ownership
     const AttrValue* GetResult() const { return squid_->GetResultAttr(); }
 };
 
 inline void Decoder::FeedBit(bool bit) {
-    if (bit)
-        PIb_.GoRight();
-    else
-        PIb_.GoLeft();
+    range_decoder_->FeedBit(bit);
+    Advance();
+}
+
+inline void Decoder::FeedBits(unsigned long long bits, int len) {
+    range_decoder_->FeedBits(bits, len);
     Advance();
 }
 
 inline void Decoder::Advance() {
-    while (1) {
-        while (r_ > l_) {
-            if (boundary_ >= PIb_.Right())
-                r_ = mid_;
-            else if (boundary_ <= PIb_.Left())
-                l_ = mid_ + 1;
-            else return;
-            NextBoundary();
-        }
-
-        if (bytes_.size() > 0) {
-            if (PIb_.exp >= (int)(bytes_.size() * 8)) {
-                ReducePI(&PIb_, bytes_);
-                bytes_.clear();
-            } else return;
-        } else if (PIb_.Left() >= PIt_.l && PIb_.Right() <= PIt_.r) {
-            squid_->ChooseNextBranch(l_);
-            if (!NextBranch()) return;
-        } else return;
+    int branch;
+    while (squid_->GetInverseCDF() != NULL ?
+           range_decoder_->Decode(*squid_->GetInverseCDF(), &branch) :
+           range_decoder_->Decode(squid_->GetProbSegs(), &branch)) {
+        squid_->ChooseNextBranch(branch);
+        if (!NextBranch()) return;
     }
 }
 
+class SquIDContext;
+
+// The memory footprint assumed for the models that do not estimate their own
+const size_t kDefaultModelFootprint = 1 << 20;
+
 /*
  * The SquIDModel class represents the local conditional probability distribution. The
  * SquIDModel object can be used to generate Decoder object which can be used to infer
  * the result attribute value based on bit string (decompressing). It can also be used to
  * create ProbInterval object which can be used for compressing.
+ *
+ * The model is immutable once EndOfData or ReadModel returns, all the per-tuple state
+ * lives in SquIDContext objects owned by the callers, so that the same model can be
+ * used by multiple threads at once as long as each thread has its own context.
  */
 class SquIDModel {
   private:
     unsigned char creator_index_;
-    Decoder decoder_;
   protected:
     std::vector<size_t> predictor_list_;
     size_t target_var_;
   public:
     SquIDModel(const std::vector<size_t>& predictors, size_t target_var);
     virtual ~SquIDModel() = 0;
-    // The Model class owns the SquID object
-    virtual SquID* GetSquID(const Tuple& tuple) = 0;
+    // Caller takes ownership, the SquID object is reused across tuples through InitSquID
+    virtual SquID* CreateSquID() const = 0;
+    // Reset the SquID object created by CreateSquID to the root for the given tuple
+    virtual void InitSquID(const Tuple& tuple, SquID* squid) const = 0;
     // Get an estimation of model cost, which is used in model selection process.
     virtual int GetModelCost() const = 0;
+    // Get a lower bound of the model cost before any tuple is fed, reference is a learned
+    // model of the same type and target variable without predictors. The model costs are
+    // clamped at 0 during model selection, hence 0 is always a valid bound. The bounds so
+    // far only cover the model description length and take the cost of the tuples as 0,
+    // e.g., TableCategorical. Models whose tuple cost may be negative keep the default,
+    // e.g., TableLaplace, whose cells cost log2(mean_abs_dev / bin_size) bits per tuple.
+    virtual int GetModelCostLowerBound(const SquIDModel& reference) const { return 0; }
+    // Get an estimation of the time to decode all the tuples learned, in the unit of one
+    // SquID branch, which is used to trade compression ratio for decoding speed.
+    virtual int64_t GetDecodeCost() const { return 0; }
+    // Get an estimation of the bytes the model may hold until EndOfData, which is used to
+    // bound the memory of the models learned at once. It may be called before any tuple
+    // is fed, hence it should account for the growth of the learning statistics.
+    virtual size_t GetMemoryFootprint() const { return kDefaultModelFootprint; }
 
     // Learning
     virtual void FeedTuple(const Tuple& tuple) { }
     virtual void EndOfData() { }
+    // Add the statistics collected by another model of the same type, predictors and
+    // target variable, so that the tuples can be fed to several models in parallel.
+    // Must be called before EndOfData on both models.
+    virtual void Merge(const SquIDModel& model);
 
     // Model Description
     virtual int GetModelDescriptionLength() const = 0;
@@ -145,18 +170,43 @@ class SquIDModel {
     const std::vector<size_t>& GetPredictorList() const { return predictor_list_; }
     size_t GetTargetVar() const { return target_var_; }
 
-    // The Model class owns the Decoder object.
-    Decoder* GetDecoder(const Tuple& tuple, const ProbInterval& PIt, 
-                        const UnitProbInterval& PIb);
+    // The context owns the SquID object, which is valid until the context is used again
+    SquID* GetSquID(const Tuple& tuple, SquIDContext* context) const;
+
+    // The context owns the Decoder object.
+    Decoder* GetDecoder(const Tuple& tuple, RangeDecoder* range_decoder,
+                        SquIDContext* context) const;
 
     // The results are appended to the end of prob_intervals vector and resultAttr 
     // will be set as the modified result AttrValue
-    void GetProbInterval(const Tuple& tuple, std::vector<ProbInterval>* prob_intervals,
-                         const AttrValue** result_attr);
+    void GetProbInterval(const Tuple& tuple, SquIDContext* context,
+                         std::vector<ProbInterval>* prob_intervals,
+                         const AttrValue** result_attr) const;
 };
 
 inline SquIDModel::~SquIDModel() {}
 
+/*
+ * Get the decode cost of looking up the table of a model for one tuple, in the unit of
+ * one SquID branch, which grows with the number of predictors to be interpreted and the
+ * chance of cache misses once the table does not fit in the L1 cache.
+ */
+double GetTableLookupCost(size_t num_of_predictors, size_t table_bytes);
+
+/*
+ * SquIDContext holds the SquID and Decoder objects of one SquIDModel, it must only be
+ * used with the model it is created from, and by one thread at a time.
+ */
+class SquIDContext {
+  private:
+    std::unique_ptr<SquID> squid_;
+    Decoder decoder_;
+  public:
+    explicit SquIDContext(const SquIDModel& model) : squid_(model.CreateSquID()) {}
+    SquID* GetSquID() { return squid_.get(); }
+    Decoder* GetDecoder() { return &decoder_; }
+};
+
 /*
  * The ModelCreator class is used to create SquIDModel object either from compressed file or
  * from scratch, the ModelCreator classes must be registered to be applied during
@@ -210,6 +260,48 @@ const std::vector<ModelCreator*>& GetAttrModel(int attr_type);
 void RegisterAttrInterpreter(int attr_type, AttrInterpreter* interpreter);
 const AttrInterpreter* GetAttrInterpreter(int attr_type);
 
+/*
+ * The AttrVector class stores copies of attribute values of one type contiguously, it
+ * is used to keep a sample of the tuples in memory. TypedAttrVector works for any
+ * attribute value class that is default constructible and copy assignable.
+ */
+class AttrVector {
+  public:
+    virtual ~AttrVector() = 0;
+    virtual void Resize(size_t size) = 0;
+    // Store a copy of the attribute value at the given index
+    virtual void Set(size_t index, const AttrValue* attr) = 0;
+    // Do not transfer ownership
+    virtual const AttrValue* Get(size_t index) const = 0;
+};
+
+inline AttrVector::~AttrVector() {}
+
+template<class T>
+class TypedAttrVector : public AttrVector {
+  private:
+    std::vector<T> values_;
+  public:
+    void Resize(size_t size) { values_.resize(size); values_.shrink_to_fit(); }
+    void Set(size_t index, const AttrValue* attr) {
+        values_[index] = *static_cast<const T*>(attr);
+    }
+    const AttrValue* Get(size_t index) const { return &values_[index]; }
+};
+
+// Caller takes ownership
+typedef AttrVector* (*AttrVectorFactory)();
+template<class T>
+AttrVector* CreateTypedAttrVector() { return new TypedAttrVector<T>(); }
+
+/*
+ * This function registers the factory of AttrVector for the attribute type, which is
+ * required by the learner to sample tuples. Each attribute type could have only one
+ * factory. CreateAttrVector returns NULL if no factory is registered.
+ */
+void RegisterAttrVector(int attr_type, AttrVectorFactory factory);
+AttrVector* CreateAttrVector(int attr_type);
+
 } // namespace db_compress
 
 #endif
@@ -2,17 +2,29 @@
 
 #include "base.h"
 #include "model.h"
+#include "utility.h"
 
 #include <vector>
 #include <set>
 #include <map>
 #include <memory>
 #include <algorithm>
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace db_compress {
 
 namespace {
 
+// During stage 1 each task has to decode the selected attributes by itself, hence the
+// active models are grouped into a few chunks per thread instead of one task per model
+const size_t kChunksPerThread = 4;
+
+// The sample size and the predictor depth of DEFAULT_COMPRESSION
+const size_t kDefaultSampleSize = 10000;
+const int kDefaultSearchDepth = 2;
+
 // New Models are appended to the end of vector
 bool CreateModel(const Schema& schema, const std::vector<size_t>& predictors, 
                  size_t target_var, const CompressionConfig& config, 
@@ -35,10 +47,45 @@ bool CreateModel(const Schema& schema, const std::vector<size_t>& predictors,
 
 }  // anonymous namespace
 
-int ModelLearner::GetModelCost(const std::vector<size_t>& predictors, size_t target) const {
-    std::set<size_t> predictors_(predictors.begin(), predictors.end());
-    auto it = stored_model_cost_.find(make_pair(predictors_, target));
-    if (it == stored_model_cost_.end())
+void SetCompressionLevel(CompressionLevel level, CompressionConfig* config) {
+    config->skip_model_learning = false;
+    config->mutual_info_learning = false;
+    switch (level) {
+      case FAST_COMPRESSION:
+        config->sample_size = 0;
+        config->max_search_depth = 0;
+        config->lookahead_depth = 0;
+        break;
+      case DEFAULT_COMPRESSION:
+        config->sample_size = kDefaultSampleSize;
+        config->max_search_depth = kDefaultSearchDepth;
+        config->lookahead_depth = 1;
+        break;
+      case MAX_COMPRESSION:
+        config->sample_size = 0;
+        config->max_search_depth = -1;
+        config->lookahead_depth = 0;
+        break;
+    }
+}
+
+ModelLearner::PredictorKey ModelLearner::GetPredictorKey(
+    const std::vector<size_t>& predictors) const {
+    PredictorKey key(schema_.attr_type.size(), false);
+    for (size_t attr : predictors)
+        key[attr] = true;
+    return key;
+}
+
+double ModelLearner::GetSelectionCost(const SquIDModel& model) const {
+    if (config_.decode_cost_weight == 0)
+        return model.GetModelCost();
+    return model.GetModelCost() + config_.decode_cost_weight * model.GetDecodeCost();
+}
+
+double ModelLearner::GetModelCost(const std::vector<size_t>& predictors, size_t target) const {
+    auto it = stored_model_cost_[target].find(GetPredictorKey(predictors));
+    if (it == stored_model_cost_[target].end())
         return -1;
     else
         return it->second;
@@ -46,11 +93,32 @@ int ModelLearner::GetModelCost(const std::vector<size_t>& predictors, size_t tar
 
 
 void ModelLearner::StoreModelCost(const SquIDModel& model) {
-    std::set<size_t> predictors(model.GetPredictorList().begin(), model.GetPredictorList().end());
     size_t target = model.GetTargetVar();
-    int previous_cost = GetModelCost(model.GetPredictorList(), model.GetTargetVar());
-    if (previous_cost == -1 || previous_cost > model.GetModelCost())
-        stored_model_cost_[make_pair(predictors, target)] = std::max(model.GetModelCost(), 0);
+    double previous_cost = GetModelCost(model.GetPredictorList(), model.GetTargetVar());
+    if (previous_cost == -1 || previous_cost > GetSelectionCost(model))
+        stored_model_cost_[target][GetPredictorKey(model.GetPredictorList())] =
+            std::max(GetSelectionCost(model), 0.0);
+}
+
+/*
+ * The stored model costs are never negative, hence a model whose lower bound is not below
+ * the bound can not be chosen over the model the candidate is expanded from, and there is
+ * no need to learn it. The bounds are only known once the reference models are learned.
+ */
+bool ModelLearner::CreateCandidateModel(const Candidate& candidate) {
+    std::vector< std::unique_ptr<SquIDModel> > models;
+    if (!CreateModel(schema_, candidate.predictors, candidate.target, config_, &models))
+        return false;
+    const std::vector< std::unique_ptr<SquIDModel> >& reference =
+        reference_model_[candidate.target];
+    for (size_t i = 0; i < models.size(); ++i) {
+        unsigned char creator_index = models[i]->GetCreatorIndex();
+        if (creator_index < reference.size() && reference[creator_index] != nullptr &&
+            models[i]->GetModelCostLowerBound(*reference[creator_index]) >= candidate.bound)
+            continue;
+        active_model_list_.push_back(std::move(models[i]));
+    }
+    return true;
 }
 
 ModelLearner::ModelLearner(const Schema& schema, const CompressionConfig& config) :
@@ -58,7 +126,14 @@ ModelLearner::ModelLearner(const Schema& schema, const CompressionConfig& config
     config_(config),
     stage_(0),
     selected_model_(schema.attr_type.size()),
-    model_predictor_list_(schema.attr_type.size()) {
+    selected_context_(config.num_of_threads < 1 ? 1 : config.num_of_threads),
+    model_predictor_list_(schema.attr_type.size()),
+    stored_model_cost_(schema.attr_type.size()),
+    reference_model_(schema.attr_type.size()),
+    learned_model_(schema.attr_type.size()),
+    sampling_(false),
+    num_of_seen_tuples_(0),
+    start_time_(std::chrono::steady_clock::now()) {
     if (config_.skip_model_learning) {
         ordered_attr_list_ = config.ordered_attr_list;
         model_predictor_list_ = config.model_predictor_list;
@@ -69,10 +144,36 @@ ModelLearner::ModelLearner(const Schema& schema, const CompressionConfig& config
         inactive_attr_.insert(config_.sort_by_attr);
         model_predictor_list_[config_.sort_by_attr].clear();
     }
-    InitActiveModelList();
+    if (stage_ == 0 && config_.sample_size > 0) {
+        sampling_ = true;
+        for (size_t i = 0; i < schema_.attr_type.size(); ++i) {
+            sample_.push_back(std::unique_ptr<AttrVector>(
+                CreateAttrVector(schema_.attr_type[i])));
+            if (sample_.back() == NULL) {
+                sampling_ = false;
+                break;
+            }
+            sample_.back()->Resize(config_.sample_size);
+        }
+        if (!sampling_)
+            sample_.clear();
+    }
+    if (stage_ == 0 && config_.mutual_info_learning)
+        mutual_info_learner_.reset(new MutualInfoLearner(schema_, config_.max_num_of_predictors,
+                                                         config_.sort_by_attr));
+    else
+        InitActiveModelList();
 }
 
 void ModelLearner::FeedTuple(const Tuple& tuple) {
+    if (sampling_) {
+        SampleTuple(tuple);
+        return;
+    }
+    if (mutual_info_learner_ != nullptr) {
+        mutual_info_learner_->FeedTuple(tuple);
+        return;
+    }
     switch (stage_) {
       case 0:
         for (size_t i = 0; i < active_model_list_.size(); ++i )
@@ -81,56 +182,183 @@ void ModelLearner::FeedTuple(const Tuple& tuple) {
       case 1:
         {
             Tuple tuple_ = tuple;
-            for (size_t i = 0; i < schema_.attr_type.size(); ++i ) {
-                size_t attr_index = ordered_attr_list_[i];
-                // Since decoding is lossy, we have to use the predicted predictors
-                // instead of the original predictors during this phase of training
-                if (inactive_attr_.count(attr_index) > 0) {
-                    const AttrValue* attr;
-                    selected_model_[attr_index]->GetProbInterval(tuple_, NULL, &attr);
-                    tuple_.attr[attr_index] = attr;
-                }
-            }
+            PredictTuple(0, &tuple_);
             for (size_t i = 0; i < active_model_list_.size(); ++i )
                 active_model_list_[i]->FeedTuple(tuple_);
         }
     } 
 }
 
+/*
+ * The active models are independent of each other, so they are split into tasks which
+ * are handed out to the threads on demand, and each task feeds the whole batch to its
+ * models. Since every model still sees the tuples in their original order, the learned
+ * models do not depend on the number of threads.
+ */
+void ModelLearner::FeedTuples(const std::vector<Tuple>& tuples) {
+    // There is one set of contexts for each thread
+    int num_of_threads = selected_context_.size();
+    if (mutual_info_learner_ != nullptr && !sampling_) {
+        mutual_info_learner_->FeedTuples(tuples, num_of_threads);
+        return;
+    }
+    if (num_of_threads == 1 || active_model_list_.size() <= 1 || stage_ == 2 || sampling_) {
+        for (size_t i = 0; i < tuples.size(); ++i)
+            FeedTuple(tuples[i]);
+        return;
+    }
+    size_t models_per_task = 1;
+    if (stage_ == 1) {
+        size_t num_of_tasks = kChunksPerThread * num_of_threads;
+        models_per_task = (active_model_list_.size() + num_of_tasks - 1) / num_of_tasks;
+    }
+    size_t num_of_tasks = (active_model_list_.size() + models_per_task - 1) / models_per_task;
+    ParallelFor(num_of_tasks, num_of_threads, [&](int worker, size_t task) {
+        size_t begin = task * models_per_task;
+        size_t end = std::min(begin + models_per_task, active_model_list_.size());
+        Tuple tuple_(schema_.attr_type.size());
+        for (size_t i = 0; i < tuples.size(); ++i) {
+            const Tuple* tuple = &tuples[i];
+            if (stage_ == 1) {
+                tuple_.attr = tuples[i].attr;
+                PredictTuple(worker, &tuple_);
+                tuple = &tuple_;
+            }
+            for (size_t j = begin; j < end; ++j)
+                active_model_list_[j]->FeedTuple(*tuple);
+        }
+    });
+}
+
+/*
+ * Since decoding is lossy, we have to use the predicted predictors instead of the
+ * original predictors during stage 1 of training, the lossless attributes are kept as
+ * they are. The predicted values are owned by the contexts of the worker, and stay valid
+ * until the next call with the same worker.
+ */
+void ModelLearner::PredictTuple(int worker, Tuple* tuple) {
+    std::vector< std::unique_ptr<SquIDContext> >& context = selected_context_[worker];
+    if (context.size() == 0)
+        context.resize(schema_.attr_type.size());
+    for (size_t i = 0; i < schema_.attr_type.size(); ++i ) {
+        size_t attr_index = ordered_attr_list_[i];
+        if (inactive_attr_.count(attr_index) > 0 && !IsLossless(attr_index)) {
+            if (context[attr_index] == NULL)
+                context[attr_index].reset(new SquIDContext(*selected_model_[attr_index]));
+            const AttrValue* attr;
+            selected_model_[attr_index]->GetProbInterval(*tuple, context[attr_index].get(),
+                                                         NULL, &attr);
+            tuple->attr[attr_index] = attr;
+        }
+    }
+}
+
+/*
+ * Reservoir sampling: the n-th tuple replaces a random slot of the sample with
+ * probability sample_size / n, hence every tuple is kept with the same probability.
+ */
+void ModelLearner::SampleTuple(const Tuple& tuple) {
+    size_t index = num_of_seen_tuples_ ++;
+    if (index >= config_.sample_size) {
+        index = std::uniform_int_distribution<size_t>(0, index)(random_);
+        if (index >= config_.sample_size)
+            return;
+    }
+    for (size_t i = 0; i < sample_.size(); ++i)
+        sample_[i]->Set(index, tuple.attr[i]);
+}
+
+void ModelLearner::LearnStructureFromSample() {
+    size_t sample_size = std::min(num_of_seen_tuples_, config_.sample_size);
+    std::vector<Tuple> tuples(sample_size, Tuple(schema_.attr_type.size()));
+    for (size_t i = 0; i < sample_size; ++i)
+    for (size_t j = 0; j < sample_.size(); ++j)
+        tuples[i].attr[j] = sample_[j]->Get(i);
+    while (stage_ == 0) {
+        FeedTuples(tuples);
+        EndOfData();
+    }
+    sample_.clear();
+}
+
+/*
+ * The predictors proposed by the mutual information are dropped from the end until some
+ * model creator accepts them, e.g. when the table would become too large.
+ */
+void ModelLearner::LearnStructureFromMutualInfo() {
+    mutual_info_learner_->Learn(&ordered_attr_list_, &model_predictor_list_);
+    mutual_info_learner_ = nullptr;
+    for (size_t i = 0; i < schema_.attr_type.size(); ++i) {
+        std::vector<size_t>& predictors = model_predictor_list_[i];
+        while (predictors.size() > 0) {
+            std::vector< std::unique_ptr<SquIDModel> > models;
+            if (CreateModel(schema_, predictors, i, config_, &models))
+                break;
+            predictors.pop_back();
+        }
+    }
+    stage_ = 1;
+    inactive_attr_.clear();
+    InitActiveModelList();
+}
+
 void ModelLearner::EndOfData() {
+    if (sampling_) {
+        sampling_ = false;
+        LearnStructureFromSample();
+        return;
+    }
+    if (mutual_info_learner_ != nullptr) {
+        LearnStructureFromMutualInfo();
+        return;
+    }
+    // The models learned in this pass of stage 0 that might be reused in stage 1
+    std::vector< std::unique_ptr<SquIDModel> > pool;
     switch (stage_) {
       case 0:
         // At the end of data, we inform each of the active models, let them compute their
         // model cost, and then store them into the stored_model_cost_ variable.
         for (size_t i = 0; i < active_model_list_.size(); i++ )
             active_model_list_[i]->EndOfData();
-        for (size_t i = 0; i < active_model_list_.size(); i++ )
+        for (size_t i = 0; i < active_model_list_.size(); i++ ) {
             StoreModelCost(*active_model_list_[i]);
-        
-        // Now if there is no longer any active model, we add the best model to ordered_attr_list_
-        // and then start a new iteration. Note that in order to save memory space, we only store
-        // the target variable and predictor variables, the actual model will be learned again
-        // during the second stage of the algorithm. 
-        if (active_model_list_.size() == 0) {
-            int next_attr = -1;
-            for (size_t i = 0; i < schema_.attr_type.size(); ++i)
-            if (inactive_attr_.count(i) == 0) {
-                if (next_attr == -1)
-                    next_attr = i;
-                else if (GetModelCost(model_predictor_list_[i], i) <
-                         GetModelCost(model_predictor_list_[next_attr], next_attr))
-                    next_attr = i;
+            const SquIDModel& model = *active_model_list_[i];
+            if (model.GetPredictorList().size() == 0) {
+                std::vector< std::unique_ptr<SquIDModel> >& reference =
+                    reference_model_[model.GetTargetVar()];
+                if (reference.size() <= model.GetCreatorIndex())
+                    reference.resize(model.GetCreatorIndex() + 1);
+                reference[model.GetCreatorIndex()] = std::move(active_model_list_[i]);
             }
-            ordered_attr_list_.push_back(next_attr);
-            inactive_attr_.insert(next_attr);
-            
-            // Now if we reach the point where models for every attribute has been selected, 
-            // we mark the end of this stage and start next stage. Otherwise we simply start
-            // another iteration.
+        }
+        if (CanReuseLearnedModels()) {
+            for (size_t i = 0; i < active_model_list_.size(); ++i)
+            if (active_model_list_[i] != nullptr)
+                pool.push_back(std::move(active_model_list_[i]));
+        }
+        // The predictor lists are only updated by the search in InitActiveModelList
+        InitActiveModelList();
+        RetainLearnedModels(&pool);
+
+        // Now if there is no longer any model to learn, we add the best model to
+        // ordered_attr_list_ and search again, without scanning the data in between. Note
+        // that in order to save memory space, we only store the target variable and predictor
+        // variables, the actual model will be learned again during the second stage of the
+        // algorithm unless it can be reused.
+        while (active_model_list_.size() == 0) {
+            if (ordered_attr_list_.size() < schema_.attr_type.size())
+                SelectNextAttr();
+            // Now if we reach the point where models for every attribute has been selected,
+            // we mark the end of this stage and start next stage.
             if (ordered_attr_list_.size() == schema_.attr_type.size()) {
                 stage_ = 1;
                 inactive_attr_.clear();
+                ReuseLearnedModels();
+                reference_model_.clear();
+                break;
             }
+            InitActiveModelList();
+            RetainLearnedModels(&pool);
         }
         break;
       case 1:
@@ -139,28 +367,113 @@ void ModelLearner::EndOfData() {
             int target_var = active_model_list_[i]->GetTargetVar();
             inactive_attr_.insert(target_var);
             if (selected_model_[target_var] == nullptr ||
-                selected_model_[target_var]->GetModelCost() >
-                active_model_list_[i]->GetModelCost() )
-            selected_model_[target_var] = std::move(active_model_list_[i]);
+                GetSelectionCost(*selected_model_[target_var]) >
+                GetSelectionCost(*active_model_list_[i]) ) {
+                selected_model_[target_var] = std::move(active_model_list_[i]);
+                // The contexts of the replaced model are no longer valid
+                for (size_t worker = 0; worker < selected_context_.size(); ++worker)
+                if (selected_context_[worker].size() > 0)
+                    selected_context_[worker][target_var].reset();
+            }
         }
         if (inactive_attr_.size() == schema_.attr_type.size())
             stage_ = 2;
     }
-    // If we still haven't reached end stage, init active models
-    if (stage_ != 2)
+    // If we still haven't reached end stage, init active models of stage 1, the ones of
+    // stage 0 are already created by the search above
+    if (stage_ == 1)
         InitActiveModelList();
 }
 
+bool ModelLearner::IsOutOfTime() const {
+    if (config_.max_learning_seconds <= 0)
+        return false;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time_;
+    return elapsed.count() >= config_.max_learning_seconds;
+}
+
+void ModelLearner::SelectNextAttr() {
+    int next_attr = -1;
+    for (size_t i = 0; i < schema_.attr_type.size(); ++i)
+    if (inactive_attr_.count(i) == 0) {
+        if (next_attr == -1)
+            next_attr = i;
+        else if (GetModelCost(model_predictor_list_[i], i) <
+                 GetModelCost(model_predictor_list_[next_attr], next_attr))
+            next_attr = i;
+    }
+    ordered_attr_list_.push_back(next_attr);
+    inactive_attr_.insert(next_attr);
+}
+
+void ModelLearner::RetainLearnedModels(std::vector< std::unique_ptr<SquIDModel> >* pool) {
+    for (size_t i = 0; i < learned_model_.size(); ++i)
+    if (learned_model_[i] != nullptr)
+        pool->push_back(std::move(learned_model_[i]));
+    for (size_t i = 0; i < pool->size(); ++i) {
+        std::unique_ptr<SquIDModel>& model = (*pool)[i];
+        size_t target = model->GetTargetVar();
+        if (GetPredictorKey(model->GetPredictorList()) !=
+            GetPredictorKey(model_predictor_list_[target]))
+            continue;
+        if (learned_model_[target] == nullptr ||
+            GetSelectionCost(*learned_model_[target]) > GetSelectionCost(*model))
+            learned_model_[target] = std::move(model);
+    }
+    pool->clear();
+}
+
+/*
+ * The models of stage 0 are learned on the original tuples, which are the same as the
+ * decoded tuples of stage 1 as long as all the predictors are lossless, hence these models
+ * need not be learned again. The models without predictors are kept as reference models.
+ * The models learned on the sample or on partial passes are not reused, since stage 1 has
+ * to learn on all the tuples.
+ */
+void ModelLearner::ReuseLearnedModels() {
+    for (size_t i = 0; i < schema_.attr_type.size(); ++i) {
+        bool lossless = true;
+        for (size_t attr : model_predictor_list_[i])
+        if (!IsLossless(attr))
+            lossless = false;
+        if (!lossless)
+            continue;
+        std::unique_ptr<SquIDModel> model(std::move(learned_model_[i]));
+        if (model_predictor_list_[i].size() == 0 && CanReuseLearnedModels()) {
+            for (size_t j = 0; j < reference_model_[i].size(); ++j) {
+                std::unique_ptr<SquIDModel>& reference = reference_model_[i][j];
+                if (reference != nullptr &&
+                    (model == nullptr ||
+                     GetSelectionCost(*model) > GetSelectionCost(*reference)))
+                    model = std::move(reference);
+            }
+        }
+        if (model != nullptr) {
+            selected_model_[i] = std::move(model);
+            inactive_attr_.insert(i);
+        }
+    }
+    learned_model_.clear();
+    if (inactive_attr_.size() == schema_.attr_type.size())
+        stage_ = 2;
+}
+
 void ModelLearner::InitActiveModelList() {
     active_model_list_.clear();
 
     if (stage_ == 0) {
+        // The models created below
+        std::vector<Candidate> candidates;
+        // Once out of time, the search only walks through the models already learned
+        bool out_of_time = IsOutOfTime();
         // In the first stage, we initially create an empty model for every inactive attribute.
         // Then we expand each of these models.
         for (size_t i = 0; i < schema_.attr_type.size(); ++i )
         if (inactive_attr_.count(i) == 0) {
             if (GetModelCost(std::vector<size_t>(), i) == -1) {
-                CreateModel(schema_, std::vector<size_t>(), i, config_, &active_model_list_);
+                Candidate candidate = {std::vector<size_t>(), i, INT_MAX};
+                if (CreateCandidateModel(candidate))
+                    candidates.push_back(candidate);
             } else {
                 // We empty the current predictor list, and search from scratch
                 model_predictor_list_[i].clear();
@@ -168,10 +481,11 @@ void ModelLearner::InitActiveModelList() {
                 // attribute that can reduce the cost in largest amount. During this process, 
                 // all models with unknown cost (a.k.a. "active" models) are added to a list, 
                 // and then choose the "inactive" model with lowest cost to expand.
-                while (1) {
+                while (config_.max_search_depth < 0 ||
+                       (int)model_predictor_list_[i].size() < config_.max_search_depth) {
                     std::vector<size_t> predictor_list(model_predictor_list_[i]);
                     std::set<size_t> predictor_set(predictor_list.begin(), predictor_list.end());
-                    int previous_cost = GetModelCost(predictor_list, i);
+                    double previous_cost = GetModelCost(predictor_list, i);
                     // Add a new slot in predictor list
                     predictor_list.push_back(0);
                     bool model_expanded = false;
@@ -179,9 +493,12 @@ void ModelLearner::InitActiveModelList() {
                     if (predictor_set.count(attr) == 0) {
                         predictor_list[predictor_set.size()] = attr;
                         if (GetModelCost(predictor_list, i) == -1) {
+                            if (out_of_time)
+                                continue;
                             // Multiple models may be associated for any predictor and target
-                            CreateModel(schema_, predictor_list, 
-                                        i, config_, &active_model_list_);
+                            Candidate candidate = {predictor_list, i, previous_cost};
+                            if (CreateCandidateModel(candidate))
+                                candidates.push_back(candidate);
                         } else if (GetModelCost(predictor_list, i) < previous_cost) {
                             model_predictor_list_[i] = predictor_list;
                             previous_cost = GetModelCost(predictor_list, i);
@@ -193,15 +510,19 @@ void ModelLearner::InitActiveModelList() {
                 }
             }
         }
+        ExpandActiveModelList(&candidates);
     } else {
         // In the second stage, we simply relearn the model selected from the first stage,
         // no model expansion is needed. However, we need to assure that the models that are
         // currently learning have predictors all lies within the range of target vars of 
-        // learned models.
+        // learned models. Lossless predictors are decoded exactly, so they are not required
+        // to be learned.
         for (size_t i = 0; i < schema_.attr_type.size(); ++i ) {
+            if (inactive_attr_.count(i) > 0)
+                continue;
             bool learnable = true;
             for (size_t attr : model_predictor_list_[i])
-            if (inactive_attr_.count(attr) == 0)
+            if (inactive_attr_.count(attr) == 0 && !IsLossless(attr))
                 learnable = false;
             if (!learnable) continue;
             if (!CreateModel(schema_, model_predictor_list_[i], i, config_, &active_model_list_))
@@ -210,5 +531,51 @@ void ModelLearner::InitActiveModelList() {
     }
 }
 
-}  // namespace db_compress
+/*
+ * The greedy search only learns the costs of the models one predictor away from the best
+ * known models in each pass. Here the candidates are expanded level by level, so that the
+ * following passes find the costs of the next few steps of the search already known. The
+ * search makes the same decisions as without lookahead, only in fewer passes. A candidate
+ * rejected by all the model creators is not expanded further, since its expansions would
+ * be rejected as well. The expansion stops once the footprints of all the active models
+ * reach the memory budget, which the models of the last candidate may exceed.
+ */
+void ModelLearner::ExpandActiveModelList(std::vector<Candidate>* candidates) {
+    // The same predictor set can be reached from several candidates
+    std::vector< std::unordered_set<PredictorKey> > created(schema_.attr_type.size());
+    for (const Candidate& candidate : *candidates)
+        created[candidate.target].insert(GetPredictorKey(candidate.predictors));
+    size_t footprint = 0;
+    for (const std::unique_ptr<SquIDModel>& model : active_model_list_)
+        footprint += model->GetMemoryFootprint();
+    for (size_t depth = 0; depth < config_.lookahead_depth; ++depth) {
+        std::vector<Candidate> next_candidates;
+        for (const Candidate& candidate : *candidates)
+        for (size_t attr : ordered_attr_list_) {
+            if (footprint >= config_.lookahead_memory_budget)
+                return;
+            if (config_.max_search_depth >= 0 &&
+                (int)candidate.predictors.size() >= config_.max_search_depth)
+                break;
+            PredictorKey key = GetPredictorKey(candidate.predictors);
+            if (key[attr])
+                continue;
+            key[attr] = true;
+            if (!created[candidate.target].insert(key).second)
+                continue;
+            // The search only moves on to cheaper models, so the expansions share the bound
+            Candidate next_candidate = candidate;
+            next_candidate.predictors.push_back(attr);
+            // Models learned in the previous passes are expanded without being learned again
+            size_t num_of_models = active_model_list_.size();
+            if (GetModelCost(next_candidate.predictors, next_candidate.target) != -1 ||
+                CreateCandidateModel(next_candidate))
+                next_candidates.push_back(next_candidate);
+            for (size_t i = num_of_models; i < active_model_list_.size(); ++i)
+                footprint += active_model_list_[i]->GetMemoryFootprint();
+        }
+        candidates->swap(next_candidates);
+    }
+}
 
+}  // namespace db_compress
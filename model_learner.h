@@ -4,11 +4,16 @@
 #include "base.h"
 #include "data_io.h"
 #include "model.h"
+#include "mutual_info_learner.h"
 
+#include <chrono>
 #include <vector>
 #include <set>
 #include <map>
 #include <memory>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace db_compress {
 
@@ -20,13 +25,83 @@ struct CompressionConfig {
     // If skip_model_learning flag is true, the following preset dependency will be used
     std::vector<size_t> ordered_attr_list;
     std::vector<std::vector<size_t>> model_predictor_list;
+    // The number of threads used to learn from and encode batches of tuples
+    int num_of_threads;
+    // If positive, a uniform sample of at most sample_size tuples is collected in one
+    // pass, and the model structure is searched on the sample in memory. An AttrVector
+    // must be registered for every attribute type, otherwise the data is scanned once
+    // for every attribute as usual.
+    size_t sample_size;
+    // If true, the model structure is derived from the pairwise mutual information of the
+    // enum interpretable attributes in one pass instead of the greedy search, which scales
+    // to wide schemas. Each attribute has at most max_num_of_predictors predictors, 1 gives
+    // the Chow-Liu tree.
+    bool mutual_info_learning;
+    size_t max_num_of_predictors;
+    // During the greedy search, the candidate models are speculatively expanded by up to
+    // lookahead_depth more predictors in the same pass, as long as the estimated memory
+    // footprints of the active models (see SquIDModel::GetMemoryFootprint) sum to less
+    // than lookahead_memory_budget bytes. Lookahead is off by default, DEFAULT_COMPRESSION
+    // enables it for its search on a sample.
+    size_t lookahead_depth;
+    size_t lookahead_memory_budget;
+    // The number of bits of compressed size worth one SquID branch of decoding time, the
+    // models are selected by their model costs plus the weighted decode costs. 0 means
+    // that only the compressed size matters.
+    double decode_cost_weight;
+    // If true, the passes of the greedy search may be cut short (see RequireFullPass), in
+    // which case the models learned during the search are never reused in stage 1.
+    bool allow_partial_passes;
+    // The greedy search does not expand models beyond max_search_depth predictors,
+    // max_search_depth = -1 means no limit
+    int max_search_depth;
+    // If positive, the greedy search stops learning new models once this many seconds
+    // have passed since the learner is created, and the attributes left are ordered by
+    // the best models found so far. Only the search is bounded, stage 1 still has to
+    // learn the selected models. The deadline is checked between the passes over the data,
+    // a pass is never cut short, hence the search may overrun it by up to one pass.
+    double max_learning_seconds;
+    CompressionConfig() : sort_by_attr(-1), skip_model_learning(false), num_of_threads(1),
+                          sample_size(0), mutual_info_learning(false),
+                          max_num_of_predictors(1), lookahead_depth(0),
+                          lookahead_memory_budget(1 << 28), decode_cost_weight(0),
+                          allow_partial_passes(false), max_search_depth(-1),
+                          max_learning_seconds(0) {}
 };
 
+/*
+ * The compression levels trade the effort of model learning for compression ratio:
+ *  FAST_COMPRESSION: Models without predictors, learned in a single pass
+ *  DEFAULT_COMPRESSION: Greedy search on a sample with at most two predictors per model
+ *  MAX_COMPRESSION: Exhaustive greedy search on all the tuples, which is the default of
+ *                   CompressionConfig
+ */
+enum CompressionLevel {
+    FAST_COMPRESSION,
+    DEFAULT_COMPRESSION,
+    MAX_COMPRESSION
+};
+
+// Set the learning parameters of the config according to the level, the other
+// parameters (e.g., allowed_err, sort_by_attr, max_learning_seconds) are not changed.
+// Sampling requires an AttrVector registered for every attribute type.
+void SetCompressionLevel(CompressionLevel level, CompressionConfig* config);
+
 /*
  * The ModelLearner class learns all the models simultaneously in an online fashion.
  */
 class ModelLearner {
   private:
+    // A model to be created during the greedy search, which is only useful if its cost
+    // can be lower than bound
+    struct Candidate {
+        std::vector<size_t> predictors;
+        size_t target;
+        double bound;
+    };
+    // The predictor set of a model as a bitset indexed by attribute
+    typedef std::vector<bool> PredictorKey;
+
     Schema schema_;
     CompressionConfig config_;
     int stage_;
@@ -34,19 +109,72 @@ class ModelLearner {
     std::set<size_t> inactive_attr_;
     std::vector< std::unique_ptr<SquIDModel> > active_model_list_;
     std::vector< std::unique_ptr<SquIDModel> > selected_model_;
+    // The contexts used by each worker thread to apply the selected models during stage 1,
+    // worker 0 is also used by FeedTuple
+    std::vector< std::vector< std::unique_ptr<SquIDContext> > > selected_context_;
     std::vector< std::vector<size_t> > model_predictor_list_;
-    std::map< std::pair<std::set<size_t>, size_t>, int> stored_model_cost_;
+    // The known model costs of each target variable
+    std::vector< std::unordered_map<PredictorKey, double> > stored_model_cost_;
+    // The learned models without predictors of each target variable and model creator,
+    // which are used to bound the costs of the other models before learning them
+    std::vector< std::vector< std::unique_ptr<SquIDModel> > > reference_model_;
+    // The learned models of model_predictor_list_ during stage 0, which are reused in
+    // stage 1 if none of their predictors is lossy
+    std::vector< std::unique_ptr<SquIDModel> > learned_model_;
+    // The reservoir sample in columnar form, sampling_ is true during the sampling pass
+    bool sampling_;
+    size_t num_of_seen_tuples_;
+    std::vector< std::unique_ptr<AttrVector> > sample_;
+    std::mt19937 random_;
+    // Only used in stage 0 if mutual_info_learning is set
+    std::unique_ptr<MutualInfoLearner> mutual_info_learner_;
+    std::chrono::steady_clock::time_point start_time_;
     
     void InitActiveModelList();
+    // Create the models of the given candidates with up to lookahead_depth more predictors
+    void ExpandActiveModelList(std::vector<Candidate>* candidates);
+    // Add the models of the candidate to the active model list, except those that can not
+    // cost less than the bound. Return false if no model creator accepts the predictors.
+    bool CreateCandidateModel(const Candidate& candidate);
+    PredictorKey GetPredictorKey(const std::vector<size_t>& predictor) const;
+    // Keep the models in the pool and learned_model_ which match model_predictor_list_ in
+    // learned_model_, this can be called again whenever model_predictor_list_ changes
+    void RetainLearnedModels(std::vector< std::unique_ptr<SquIDModel> >* pool);
+    // Select the learned models whose predictors are lossless at the start of stage 1
+    void ReuseLearnedModels();
+    bool IsLossless(size_t attr) const { return config_.allowed_err[attr] == 0; }
+    // Return true if max_learning_seconds have passed
+    bool IsOutOfTime() const;
+    // Add the attribute with the cheapest model to ordered_attr_list_
+    void SelectNextAttr();
+    // The models of stage 0 can only be reused if they have seen all the tuples
+    bool CanReuseLearnedModels() const {
+        return sample_.empty() && !config_.allow_partial_passes;
+    }
+    void SampleTuple(const Tuple& tuple);
+    // Run all the iterations of stage 0 on the sample
+    void LearnStructureFromSample();
+    // Finish stage 0 with the structure derived by mutual_info_learner_
+    void LearnStructureFromMutualInfo();
+    // Replace the already selected attributes with their decoded values during stage 1
+    void PredictTuple(int worker, Tuple* tuple);
+    // The cost used to compare the models, which accounts for the decode cost
+    double GetSelectionCost(const SquIDModel& model) const;
     void StoreModelCost(const SquIDModel& model);
     // Get the model cost based on predictors and target variable.
     // If not known, return -1
-    int GetModelCost(const std::vector<size_t>& predictor, size_t target) const;
+    double GetModelCost(const std::vector<size_t>& predictor, size_t target) const;
   public:
     ModelLearner(const Schema& schema, const CompressionConfig& config);
     // These functions are used to learn the Model objects.
     void FeedTuple(const Tuple& tuple);
-    bool RequireFullPass() const { return stage_ != 0; }
+    // Same as calling FeedTuple on each of the tuples in order, but the active models
+    // are fed on multiple threads
+    void FeedTuples(const std::vector<Tuple>& tuples);
+    bool RequireFullPass() const {
+        return stage_ != 0 || sampling_ || mutual_info_learner_ != nullptr ||
+               !config_.allow_partial_passes;
+    }
     bool RequireMoreIterations() const { return stage_ != 2; }
     void EndOfData();
     /*
@@ -11,6 +11,9 @@ namespace db_compress {
 std::map<int, int> model_cost;
 CompressionConfig config;
 Schema schema;
+// If true, the mock models know their exact costs before learning
+bool exact_lower_bound = false;
+int num_of_fed_tuples = 0;
 
 inline int GetCost(const std::vector<size_t>& pred, int target) {
     int index = 0;
@@ -25,6 +28,7 @@ class MockAttr : public AttrValue {
   private:
     int val_;
   public:
+    MockAttr() : val_(0) {}
     MockAttr(int val) : val_(val) {}
     int Value() const { return val_; }
 };
@@ -35,6 +39,7 @@ class MockTree : public SquID {
     MockAttr attr_;
   public:
     MockTree() : first_step_(true), attr_(0) {}
+    void Init() { first_step_ = true; }
     bool HasNextBranch() const { return first_step_; }
     void GenerateNextBranch() { first_step_ = false; }
     int GetNextBranch(const AttrValue* attr) const { return 0; }
@@ -44,12 +49,15 @@ class MockTree : public SquID {
 
 class MockModel : public SquIDModel {
   private:
-    MockTree tree_;
     int a_, b_, c_;
   public:
     MockModel(const std::vector<size_t>& pred, size_t target) : SquIDModel(pred, target) {}
-    SquID* GetSquID(const Tuple& tuple) { return &tree_; }
+    SquID* CreateSquID() const { return new MockTree(); }
+    void InitSquID(const Tuple& tuple, SquID* squid) const {
+        static_cast<MockTree*>(squid)->Init();
+    }
     void FeedTuple(const Tuple& tuple) {
+        ++ num_of_fed_tuples;
         a_ = static_cast<const MockAttr*>(tuple.attr[0])->Value();
         b_ = static_cast<const MockAttr*>(tuple.attr[1])->Value();
         c_ = static_cast<const MockAttr*>(tuple.attr[2])->Value();
@@ -60,6 +68,10 @@ class MockModel : public SquIDModel {
     int GetModelCost() const {
         return GetCost(predictor_list_, target_var_);
     }
+    int GetModelCostLowerBound(const SquIDModel& reference) const {
+        return exact_lower_bound ? GetModelCost() : 0;
+    }
+    int64_t GetDecodeCost() const { return predictor_list_.size(); }
 };
 
 class MockModelCreator : public ModelCreator {
@@ -88,11 +100,13 @@ void PrepareData() {
     model_cost[12] = 12;
     model_cost[23] = 5;
     model_cost[32] = 5;
+    model_cost[31] = 15;
     std::vector<int> attr(3);
     attr[0] = attr[1] = attr[2] = 0;
     schema = Schema(attr);
     RegisterAttrModel(0, new MockModelCreator());
-    config.allowed_err.resize(3);
+    // The mock models decode every attribute value as 0, so the attributes are lossy
+    config.allowed_err.resize(3, 0.5);
 }
 
 void TestWithPrimaryAttr() {
@@ -113,10 +127,12 @@ void TestWithPrimaryAttr() {
     std::unique_ptr<SquIDModel> a(learner.GetModel(0));
     std::unique_ptr<SquIDModel> b(learner.GetModel(1));
     std::unique_ptr<SquIDModel> c(learner.GetModel(2));
-    if (a->GetTargetVar() != 0 || a->GetPredictorList().size() != 0 || Check(a.get()) != 111)
+    // The model of attr 2 has no predictors, so it is reused from stage 0, while the other
+    // two models are learned in the same pass with attr 2 decoded as 0
+    if (a->GetTargetVar() != 0 || a->GetPredictorList().size() != 0 || Check(a.get()) != 110)
         std::cerr << "Model Learner w/ Primary Attr Unit Test Failed!\n";
     if (b->GetTargetVar() != 1 || b->GetPredictorList().size() != 1 ||
-        b->GetPredictorList()[0] != 2 || Check(b.get()) != 10)
+        b->GetPredictorList()[0] != 2 || Check(b.get()) != 110)
         std::cerr << "Model Learner w/ Primary Attr Unit Test Failed!\n";
     if (c->GetTargetVar() != 2 || c->GetPredictorList().size() != 0 || Check(c.get()) != 111) 
         std::cerr << "Model Learner w/ Primary Attr Unit Test Failed!\n";
@@ -150,10 +166,227 @@ void TestWithoutPrimaryAttr() {
         std::cerr << "Model Learner w/o Primary Attr Unit Test Failed!\n";
 }
 
+void TestParallelLearning() {
+    config.sort_by_attr = -1;
+    config.num_of_threads = 4;
+    ModelLearner learner(schema, config);
+    MockAttr attr(1);
+    std::vector<Tuple> tuples(5, Tuple(3));
+    for (size_t i = 0; i < tuples.size(); ++i)
+        tuples[i].attr[0] = tuples[i].attr[1] = tuples[i].attr[2] = &attr;
+    while (1) {
+        learner.FeedTuples(tuples);
+        learner.EndOfData();
+        if (!learner.RequireMoreIterations())
+            break;
+    }
+    config.num_of_threads = 1;
+    // The result should be the same as learning on a single thread
+    std::vector<size_t> attr_vec = learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Parallel Learning Unit Test Failed!\n";
+    std::unique_ptr<SquIDModel> a(learner.GetModel(0));
+    std::unique_ptr<SquIDModel> b(learner.GetModel(1));
+    if (a->GetPredictorList().size() != 2 || Check(a.get()) != 100)
+        std::cerr << "Model Learner Parallel Learning Unit Test Failed!\n";
+    if (b->GetPredictorList().size() != 1 || Check(b.get()) != 110)
+        std::cerr << "Model Learner Parallel Learning Unit Test Failed!\n";
+}
+
+void TestSampledLearning() {
+    config.sort_by_attr = -1;
+    config.sample_size = 3;
+    RegisterAttrVector(0, &CreateTypedAttrVector<MockAttr>);
+    ModelLearner learner(schema, config);
+    config.sample_size = 0;
+    std::vector<MockAttr> attr;
+    for (int i = 0; i < 10; ++i)
+        attr.push_back(MockAttr(1));
+    int passes = 0;
+    while (1) {
+        // The structure is learned in the first pass, which has to see all the tuples
+        if (passes == 0 && !learner.RequireFullPass())
+            std::cerr << "Model Learner Sampled Learning Unit Test Failed!\n";
+        for (int i = 0; i < 10; ++i) {
+            Tuple tuple(3);
+            tuple.attr[0] = tuple.attr[1] = tuple.attr[2] = &attr[i];
+            learner.FeedTuple(tuple);
+        }
+        learner.EndOfData();
+        ++ passes;
+        if (!learner.RequireMoreIterations())
+            break;
+    }
+    // One sampling pass and then one pass for each level of the dependencies in stage 1,
+    // while the same result as TestWithoutPrimaryAttr is expected
+    if (passes != 4)
+        std::cerr << "Model Learner Sampled Learning Unit Test Failed!\n";
+    std::vector<size_t> attr_vec = learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Sampled Learning Unit Test Failed!\n";
+    std::unique_ptr<SquIDModel> a(learner.GetModel(0));
+    std::unique_ptr<SquIDModel> b(learner.GetModel(1));
+    if (a->GetPredictorList().size() != 2 || Check(a.get()) != 100)
+        std::cerr << "Model Learner Sampled Learning Unit Test Failed!\n";
+    if (b->GetPredictorList().size() != 1 || Check(b.get()) != 110)
+        std::cerr << "Model Learner Sampled Learning Unit Test Failed!\n";
+}
+
+// Return the number of passes taken by the learner
+int CountPasses(ModelLearner* learner) {
+    MockAttr attr(1);
+    Tuple tuple(3);
+    tuple.attr[0] = tuple.attr[1] = tuple.attr[2] = &attr;
+    int passes = 0;
+    while (1) {
+        learner->FeedTuple(tuple);
+        learner->EndOfData();
+        ++ passes;
+        if (!learner->RequireMoreIterations())
+            break;
+    }
+    return passes;
+}
+
+// Return the number of passes taken to learn the same result as TestWithoutPrimaryAttr
+int LearnWithLookahead(size_t depth) {
+    config.sort_by_attr = -1;
+    config.lookahead_depth = depth;
+    ModelLearner learner(schema, config);
+    config.lookahead_depth = 0;
+    int passes = CountPasses(&learner);
+    std::vector<size_t> attr_vec = learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Lookahead Unit Test Failed!\n";
+    std::unique_ptr<SquIDModel> a(learner.GetModel(0));
+    std::unique_ptr<SquIDModel> b(learner.GetModel(1));
+    if (a->GetPredictorList().size() != 2 || Check(a.get()) != 100)
+        std::cerr << "Model Learner Lookahead Unit Test Failed!\n";
+    if (b->GetPredictorList().size() != 1 || Check(b.get()) != 110)
+        std::cerr << "Model Learner Lookahead Unit Test Failed!\n";
+    return passes;
+}
+
+void TestLookahead() {
+    int passes = LearnWithLookahead(0);
+    if (LearnWithLookahead(1) >= passes)
+        std::cerr << "Model Learner Lookahead Unit Test Failed!\n";
+    // A budget below the footprint of one model disables lookahead
+    config.lookahead_memory_budget = kDefaultModelFootprint - 1;
+    if (LearnWithLookahead(1) != passes)
+        std::cerr << "Model Learner Lookahead Unit Test Failed!\n";
+    config.lookahead_memory_budget = 1 << 28;
+}
+
+void TestCostBoundPruning() {
+    num_of_fed_tuples = 0;
+    LearnWithLookahead(0);
+    int fed_tuples = num_of_fed_tuples;
+    // The model predicting attr 0 from attr 2 costs more than the one without predictors,
+    // hence it is never learned
+    exact_lower_bound = true;
+    num_of_fed_tuples = 0;
+    LearnWithLookahead(0);
+    if (num_of_fed_tuples != fed_tuples - 1)
+        std::cerr << "Model Learner Cost Bound Pruning Unit Test Failed!\n";
+    exact_lower_bound = false;
+}
+
+void TestLosslessPredictors() {
+    config.sort_by_attr = -1;
+    config.allowed_err.assign(3, 0);
+    ModelLearner learner(schema, config);
+    config.allowed_err.assign(3, 0.5);
+    int passes = CountPasses(&learner);
+    // Same structure as TestWithoutPrimaryAttr, but all the models are reused from stage 0,
+    // where they see the original tuples, so stage 1 takes no pass
+    if (passes >= LearnWithLookahead(1))
+        std::cerr << "Model Learner Lossless Predictors Unit Test Failed!\n";
+    std::vector<size_t> attr_vec = learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Lossless Predictors Unit Test Failed!\n";
+    for (size_t i = 0; i < 3; ++i) {
+        std::unique_ptr<SquIDModel> model(learner.GetModel(i));
+        if (model->GetPredictorList().size() != 2 - i || Check(model.get()) != 111)
+            std::cerr << "Model Learner Lossless Predictors Unit Test Failed!\n";
+    }
+}
+
+void TestDecodeCost() {
+    config.sort_by_attr = -1;
+    // Every predictor costs more than it saves
+    config.decode_cost_weight = 10;
+    ModelLearner learner(schema, config);
+    config.decode_cost_weight = 0;
+    CountPasses(&learner);
+    // The attributes are ordered by the costs of models without predictors
+    std::vector<size_t> attr_vec = learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Decode Cost Unit Test Failed!\n";
+    for (size_t i = 0; i < 3; ++i) {
+        std::unique_ptr<SquIDModel> model(learner.GetModel(i));
+        if (model->GetPredictorList().size() != 0)
+            std::cerr << "Model Learner Decode Cost Unit Test Failed!\n";
+    }
+}
+
+void TestCompressionLevel() {
+    CompressionConfig fast_config = config;
+    SetCompressionLevel(FAST_COMPRESSION, &fast_config);
+    ModelLearner fast_learner(schema, fast_config);
+    // The models without predictors are learned and reused in the same pass
+    if (CountPasses(&fast_learner) != 1)
+        std::cerr << "Model Learner Compression Level Unit Test Failed!\n";
+    std::vector<size_t> attr_vec = fast_learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Compression Level Unit Test Failed!\n";
+    for (size_t i = 0; i < 3; ++i) {
+        std::unique_ptr<SquIDModel> model(fast_learner.GetModel(i));
+        if (model->GetPredictorList().size() != 0 || Check(model.get()) != 111)
+            std::cerr << "Model Learner Compression Level Unit Test Failed!\n";
+    }
+
+    CompressionConfig depth_config = config;
+    depth_config.max_search_depth = 1;
+    ModelLearner depth_learner(schema, depth_config);
+    CountPasses(&depth_learner);
+    attr_vec = depth_learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Compression Level Unit Test Failed!\n";
+    std::unique_ptr<SquIDModel> a(depth_learner.GetModel(0));
+    if (a->GetPredictorList().size() != 1 || a->GetPredictorList()[0] != 1)
+        std::cerr << "Model Learner Compression Level Unit Test Failed!\n";
+}
+
+void TestLearningTimeBudget() {
+    CompressionConfig budget_config = config;
+    budget_config.max_learning_seconds = 1e-9;
+    ModelLearner learner(schema, budget_config);
+    // The search ends after the first pass with the models found so far
+    if (CountPasses(&learner) != 1)
+        std::cerr << "Model Learner Time Budget Unit Test Failed!\n";
+    std::vector<size_t> attr_vec = learner.GetOrderOfAttributes();
+    if (attr_vec[0] != 2 || attr_vec[1] != 1 || attr_vec[2] != 0)
+        std::cerr << "Model Learner Time Budget Unit Test Failed!\n";
+    for (size_t i = 0; i < 3; ++i) {
+        std::unique_ptr<SquIDModel> model(learner.GetModel(i));
+        if (model->GetPredictorList().size() != 0)
+            std::cerr << "Model Learner Time Budget Unit Test Failed!\n";
+    }
+}
+
 void Test() {
     PrepareData();
     TestWithPrimaryAttr();
     TestWithoutPrimaryAttr();
+    TestParallelLearning();
+    TestSampledLearning();
+    TestLookahead();
+    TestCostBoundPruning();
+    TestLosslessPredictors();
+    TestDecodeCost();
+    TestCompressionLevel();
+    TestLearningTimeBudget();
 }
 
 }  // namespace db_compress
@@ -1,6 +1,7 @@
 #include "base.h"
 #include "utility.h"
 #include "model.h"
+#include "range_coder.h"
 
 #include <cmath>
 #include <vector>
@@ -12,6 +13,7 @@ class MockAttr : public AttrValue {
   private:
     int val_;
   public:
+    MockAttr() : val_(0) {}
     MockAttr(int val) : val_(val) {}
     int Val() const { return val_; }
 };
@@ -21,10 +23,11 @@ class MockSquID : public SquID {
     int step_;
     int val_;
     MockAttr attr_;
+    Prob prob_;
   public:
-    MockSquID() : step_(0), val_(0), attr_(0) { prob_segs_.resize(1); }
+    MockSquID() : step_(0), val_(0), attr_(0) { prob_segs_ = ProbSegs(&prob_, 1); }
     bool HasNextBranch() const { return step_ < 3; }
-    void GenerateNextBranch() { prob_segs_[0] = GetProb(1, step_); }
+    void GenerateNextBranch() { prob_ = GetProb(1, step_); }
     int GetNextBranch(const AttrValue* attr) const {
         int val = static_cast<const MockAttr*>(attr)->Val();
         return (val >> (2 - step_)) & 1;
@@ -49,51 +52,60 @@ void TestSquID() {
 }
 
 void TestDecoder() {
-    std::vector<int> stop_time(8, -1), result(8, -1);
-    std::vector<ProbInterval> resultPIt;
-    std::vector<UnitProbInterval> resultPIb;
-    for (int i = 0; i < 8; ++i) {
-        resultPIt.push_back(ProbInterval(GetZeroProb(), GetZeroProb()));
-        resultPIb.push_back(UnitProbInterval(0, 0));
-    }
-    ProbInterval PIt(GetProb(3, 3), GetProb(6, 3));
-    UnitProbInterval PIb(2, 2);
-    for (int i = 0; i < 8; ++i) {
+    // Values with the highest bit set have zero probability, thus are not tested
+    int true_length[4] = {3, 2, 3, 2};
+    for (int i = 0; i < 4; ++i) {
+        MockAttr attr(i);
+        MockSquID encode_tree;
+        RangeEncoder encoder;
+        while (encode_tree.HasNextBranch()) {
+            encode_tree.GenerateNextBranch();
+            int branch = encode_tree.GetNextBranch(&attr);
+            encoder.Encode(encode_tree.GetProbInterval(branch));
+            encode_tree.ChooseNextBranch(branch);
+        }
+        BitString bit_string;
+        bit_string.Clear();
+        encoder.Finish(&bit_string);
+        if ((int)bit_string.length != true_length[i])
+            std::cerr << "Decoder Unit Test Failed!\n";
+
         MockSquID tree;
+        RangeDecoder range_decoder;
         Decoder decoder;
-        decoder.Init(&tree, PIt, PIb);
-        for (int j = 0; j < 4; ++j) {
-            if (decoder.IsEnd()) {
-                stop_time[i] = j;
-                const MockAttr* attr = static_cast<const MockAttr*>(decoder.GetResult());
-                result[i] = attr->Val();
-                resultPIt[i] = decoder.GetPIt();
-                resultPIb[i] = decoder.GetPIb();
-                break;
-            } else if (j != 3)
-                decoder.FeedBit((i >> (2 - j)) & 1);
+        decoder.Init(&tree, &range_decoder);
+        size_t stop_time = 0;
+        while (!decoder.IsEnd() && stop_time < bit_string.length) {
+            decoder.FeedBit((bit_string.bits[0] >> (31 - stop_time)) & 1);
+            ++ stop_time;
         }
+        if (!decoder.IsEnd() || stop_time != bit_string.length)
+            std::cerr << "Decoder Unit Test Failed!\n";
+        else if (static_cast<const MockAttr*>(decoder.GetResult())->Val() != i)
+            std::cerr << "Decoder Unit Test Failed!\n";
+    }
+}
+
+void TestAttrVector() {
+    if (CreateAttrVector(0) != NULL)
+        std::cerr << "Attr Vector Unit Test Failed!\n";
+    RegisterAttrVector(0, &CreateTypedAttrVector<MockAttr>);
+    std::unique_ptr<AttrVector> vec(CreateAttrVector(0));
+    vec->Resize(3);
+    for (int i = 0; i < 3; ++i) {
+        // The vector keeps copies, so the original value can be changed afterwards
+        MockAttr attr(i * 10);
+        vec->Set(i, &attr);
     }
-    int true_stop_time[8] = {2, 2, 3, -1, 1, 1, 1, 1};
-    int true_result[8] = {1, 1, 2, -1, 3, 3, 3, 3};
-    for (int i = 0; i < 8; ++i)
-    if (stop_time[i] != true_stop_time[i] || result[i] != true_result[i])
-        std::cerr << "Decoder Unit Test Failed!\n";
-    int true_PIt_l[8] = {27, 27, 36, 0, 39, 39, 39, 39};
-    int true_PIt_r[8] = {36, 36, 39, 0, 48, 48, 48, 48};
-    int true_PIb_num[8] = {8, 8, 18, 0, 5, 5, 5, 5};
-    int true_PIb_exp[8] = {4, 4, 5, 0, 3, 3, 3, 3};
-    for (int i = 0; i < 8; ++i)
-    if (resultPIt[i].l != GetProb(true_PIt_l[i], 6) ||
-        resultPIt[i].r != GetProb(true_PIt_r[i], 6) ||
-        resultPIb[i].num != true_PIb_num[i] ||
-        resultPIb[i].exp != true_PIb_exp[i])
-        std::cerr << "Decoder Unit Test Failed!\n";
+    for (int i = 0; i < 3; ++i)
+    if (static_cast<const MockAttr*>(vec->Get(i))->Val() != i * 10)
+        std::cerr << "Attr Vector Unit Test Failed!\n";
 }
 
 void Test() {
     TestSquID();
     TestDecoder();
+    TestAttrVector();
 }
 
 }  // namespace db_compress
@@ -0,0 +1,201 @@
+#include "mutual_info_learner.h"
+
+#include "base.h"
+#include "model.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace db_compress {
+
+MutualInfoLearner::MutualInfoLearner(const Schema& schema, size_t max_predictors, int root) :
+    schema_(schema),
+    max_predictors_(max_predictors),
+    root_(root),
+    num_of_tuples_(0) {
+    for (size_t i = 0; i < schema_.attr_type.size(); ++i) {
+        const AttrInterpreter* interpreter = GetAttrInterpreter(schema_.attr_type[i]);
+        if (interpreter->EnumInterpretable() && interpreter->EnumCap() > 0) {
+            enum_attr_.push_back(i);
+            interpreter_.push_back(interpreter);
+            cap_.push_back(interpreter->EnumCap());
+        }
+    }
+    size_t num_of_enum = enum_attr_.size();
+    pair_offset_.resize(num_of_enum * num_of_enum, NO_PAIR);
+    // The pairs are admitted from the smallest one, by their number of cells
+    std::vector< std::pair<unsigned long long, size_t> > pairs;
+    for (size_t k = 0; k < num_of_enum; ++k)
+    for (size_t l = k + 1; l < num_of_enum; ++l) {
+        unsigned long long size = (unsigned long long)cap_[k] * cap_[l];
+        if (size <= MAX_PAIR_SIZE)
+            pairs.push_back(std::make_pair(size, k * num_of_enum + l));
+    }
+    std::sort(pairs.begin(), pairs.end());
+    size_t count_size = 0, marginal_size = 0;
+    for (size_t i = 0; i < pairs.size() && count_size + pairs[i].first <= MAX_COUNT_SIZE; ++i) {
+        pair_offset_[pairs[i].second] = count_size;
+        count_size += pairs[i].first;
+    }
+    for (size_t k = 0; k < num_of_enum; ++k) {
+        marginal_offset_.push_back(marginal_size);
+        marginal_size += cap_[k];
+    }
+    count_.resize(count_size);
+    marginal_.resize(marginal_size);
+    value_.resize(num_of_enum);
+}
+
+void MutualInfoLearner::InterpretTuple(const Tuple& tuple, size_t* value) const {
+    for (size_t k = 0; k < enum_attr_.size(); ++k)
+        value[k] = interpreter_[k]->EnumInterpret(tuple.attr[enum_attr_[k]]);
+}
+
+void MutualInfoLearner::CountPairs(size_t k, const size_t* value) {
+    size_t num_of_enum = enum_attr_.size();
+    ++ marginal_[marginal_offset_[k] + value[k]];
+    const size_t* offset = &pair_offset_[k * num_of_enum];
+    for (size_t l = k + 1; l < num_of_enum; ++l)
+    if (offset[l] != NO_PAIR)
+        ++ count_[offset[l] + value[k] * cap_[l] + value[l]];
+}
+
+void MutualInfoLearner::FeedTuple(const Tuple& tuple) {
+    InterpretTuple(tuple, value_.data());
+    for (size_t k = 0; k < enum_attr_.size(); ++k)
+        CountPairs(k, value_.data());
+    ++ num_of_tuples_;
+}
+
+/*
+ * The tuples are interpreted first, then each task counts the pairs of one attribute
+ * with all the attributes after it, so that no two threads touch the same counts.
+ */
+void MutualInfoLearner::FeedTuples(const std::vector<Tuple>& tuples, int num_of_threads) {
+    size_t num_of_enum = enum_attr_.size();
+    std::vector<size_t> value(tuples.size() * num_of_enum);
+    for (size_t i = 0; i < tuples.size(); ++i)
+        InterpretTuple(tuples[i], &value[i * num_of_enum]);
+    ParallelFor(num_of_enum, num_of_threads, [&](int worker, size_t k) {
+        for (size_t i = 0; i < tuples.size(); ++i)
+            CountPairs(k, &value[i * num_of_enum]);
+    });
+    num_of_tuples_ += tuples.size();
+}
+
+double MutualInfoLearner::GetMutualInfoByIndex(size_t k, size_t l) const {
+    if (k > l)
+        std::swap(k, l);
+    if (k == l || num_of_tuples_ == 0 || pair_offset_[k * enum_attr_.size() + l] == NO_PAIR)
+        return 0;
+    const uint32_t* count = &count_[pair_offset_[k * enum_attr_.size() + l]];
+    const uint32_t* marginal_k = &marginal_[marginal_offset_[k]];
+    const uint32_t* marginal_l = &marginal_[marginal_offset_[l]];
+    double total = num_of_tuples_, ret = 0;
+    for (size_t a = 0; a < cap_[k]; ++a)
+    for (size_t b = 0; b < cap_[l]; ++b) {
+        size_t c = count[a * cap_[l] + b];
+        if (c > 0)
+            ret += c * log2(c * total / ((double)marginal_k[a] * marginal_l[b]));
+    }
+    return ret / total;
+}
+
+double MutualInfoLearner::GetMutualInfo(size_t attr_a, size_t attr_b) const {
+    auto it_a = std::find(enum_attr_.begin(), enum_attr_.end(), attr_a);
+    auto it_b = std::find(enum_attr_.begin(), enum_attr_.end(), attr_b);
+    if (it_a == enum_attr_.end() || it_b == enum_attr_.end())
+        return 0;
+    return GetMutualInfoByIndex(it_a - enum_attr_.begin(), it_b - enum_attr_.begin());
+}
+
+/*
+ * Using the pair as predictor and target saves about N * I bits, while the table grows
+ * by about (cap_k - 1) * (cap_l - 1) parameters, each of which costs log2(N) / 2 bits.
+ */
+bool MutualInfoLearner::IsSignificant(size_t k, size_t l) const {
+    if (num_of_tuples_ <= 1)
+        return false;
+    double gain = num_of_tuples_ * GetMutualInfoByIndex(k, l);
+    double cost = (cap_[k] - 1) * (cap_[l] - 1) * log2(num_of_tuples_) / 2;
+    return gain > cost;
+}
+
+/*
+ * The maximum spanning forest is built with Prim's algorithm, the attributes are ordered
+ * as they join the forest, hence the parent of each attribute precedes it. A new tree is
+ * started from the root or the first remaining attribute when no attribute can be joined.
+ */
+void MutualInfoLearner::Learn(std::vector<size_t>* ordered_attr_list,
+                              std::vector< std::vector<size_t> >* predictor_list) const {
+    size_t num_of_enum = enum_attr_.size();
+    std::vector<double> mutual_info(num_of_enum * num_of_enum, -1);
+    for (size_t k = 0; k < num_of_enum; ++k)
+    for (size_t l = k + 1; l < num_of_enum; ++l)
+    if (IsSignificant(k, l))
+        mutual_info[k * num_of_enum + l] = mutual_info[l * num_of_enum + k] =
+            GetMutualInfoByIndex(k, l);
+
+    ordered_attr_list->clear();
+    predictor_list->assign(schema_.attr_type.size(), std::vector<size_t>());
+    int root = -1;
+    if (root_ != -1) {
+        auto it = std::find(enum_attr_.begin(), enum_attr_.end(), (size_t)root_);
+        if (it == enum_attr_.end())
+            ordered_attr_list->push_back(root_);
+        else
+            root = it - enum_attr_.begin();
+    }
+
+    std::vector<bool> joined(num_of_enum, false);
+    std::vector<double> best(num_of_enum, -1);
+    std::vector<int> parent(num_of_enum, -1);
+    std::vector<size_t> order;
+    for (size_t step = 0; step < num_of_enum; ++step) {
+        int next = -1;
+        for (size_t k = 0; k < num_of_enum; ++k)
+        if (!joined[k] && best[k] >= 0 && (next == -1 || best[k] > best[next]))
+            next = k;
+        if (next == -1) {
+            next = (step == 0 && root != -1 ? root : 0);
+            while (joined[next])
+                ++ next;
+        }
+        joined[next] = true;
+        order.push_back(next);
+        for (size_t k = 0; k < num_of_enum; ++k)
+        if (!joined[k] && mutual_info[next * num_of_enum + k] > best[k]) {
+            best[k] = mutual_info[next * num_of_enum + k];
+            parent[k] = next;
+        }
+    }
+
+    // The tree parent comes first, followed by the other preceding attributes with the
+    // highest mutual information
+    for (size_t pos = 0; pos < order.size(); ++pos) {
+        size_t k = order[pos];
+        std::vector<size_t>& predictors = (*predictor_list)[enum_attr_[k]];
+        if (parent[k] == -1 || max_predictors_ == 0)
+            continue;
+        predictors.push_back(enum_attr_[parent[k]]);
+        std::vector< std::pair<double, size_t> > candidates;
+        for (size_t i = 0; i < pos; ++i)
+        if ((int)order[i] != parent[k] && mutual_info[k * num_of_enum + order[i]] >= 0)
+            candidates.push_back(std::make_pair(-mutual_info[k * num_of_enum + order[i]],
+                                                order[i]));
+        std::sort(candidates.begin(), candidates.end());
+        for (size_t i = 0; i < candidates.size() && predictors.size() < max_predictors_; ++i)
+            predictors.push_back(enum_attr_[candidates[i].second]);
+    }
+
+    for (size_t k : order)
+        ordered_attr_list->push_back(enum_attr_[k]);
+    for (size_t i = 0; i < schema_.attr_type.size(); ++i)
+    if (std::find(ordered_attr_list->begin(), ordered_attr_list->end(), i) ==
+        ordered_attr_list->end())
+        ordered_attr_list->push_back(i);
+}
+
+}  // namespace db_compress
@@ -0,0 +1,77 @@
+/*
+ * The header file of the one-pass structure learner based on mutual information
+ */
+
+#ifndef MUTUAL_INFO_LEARNER_H
+#define MUTUAL_INFO_LEARNER_H
+
+#include "base.h"
+#include "model.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace db_compress {
+
+/*
+ * MutualInfoLearner collects the pairwise joint counts of all the enum interpretable
+ * attributes in one pass, and derives the order of attributes and the predictors of each
+ * attribute from the maximum spanning tree of pairwise mutual information (Chow-Liu tree).
+ * Each attribute may additionally take the preceding attributes with the highest mutual
+ * information as predictors, up to max_predictors in total. Edges whose mutual information
+ * does not pay for the larger table (in the MDL sense) are ignored. The other attributes
+ * are placed after the enum interpretable ones and have no predictors. The joint counts
+ * of a pair are only kept if the pair has at most MAX_PAIR_SIZE cells, and the pairs are
+ * admitted from the smallest up to MAX_COUNT_SIZE cells in total, the other pairs have
+ * no mutual information. The counts are 32 bits, hence at most 2^32 - 1 tuples are fed.
+ */
+class MutualInfoLearner {
+  private:
+    const size_t MAX_PAIR_SIZE = 1 << 24;
+    const size_t MAX_COUNT_SIZE = 1 << 26;
+    // The pair offset of the pairs whose joint counts are not kept
+    const size_t NO_PAIR = static_cast<size_t>(-1);
+
+    Schema schema_;
+    size_t max_predictors_;
+    int root_;
+    size_t num_of_tuples_;
+    // The enum interpretable attributes, their interpreters and caps
+    std::vector<size_t> enum_attr_;
+    std::vector<const AttrInterpreter*> interpreter_;
+    std::vector<size_t> cap_;
+    // The joint counts of the k-th and l-th enum attributes (k < l) form a cap_[k] * cap_[l]
+    // matrix starting at count_[pair_offset_[k * enum_attr_.size() + l]], or the offset is
+    // NO_PAIR, and the marginal counts of the k-th enum attribute start at
+    // marginal_[marginal_offset_[k]]
+    std::vector<size_t> pair_offset_;
+    std::vector<uint32_t> count_;
+    std::vector<size_t> marginal_offset_;
+    std::vector<uint32_t> marginal_;
+    // The interpreted values of the current tuple
+    std::vector<size_t> value_;
+
+    // Interpret the enum attributes of the tuple, value must have enum_attr_.size() slots
+    void InterpretTuple(const Tuple& tuple, size_t* value) const;
+    // Count the pairs between the k-th enum attribute and the ones after it
+    void CountPairs(size_t k, const size_t* value);
+    // Return true if the mutual information of the pair pays off in the MDL sense
+    bool IsSignificant(size_t k, size_t l) const;
+    double GetMutualInfoByIndex(size_t k, size_t l) const;
+  public:
+    // root is the attribute placed first, -1 means no specific attribute
+    MutualInfoLearner(const Schema& schema, size_t max_predictors, int root);
+    void FeedTuple(const Tuple& tuple);
+    // Same as calling FeedTuple on each of the tuples, but counts on multiple threads
+    void FeedTuples(const std::vector<Tuple>& tuples, int num_of_threads);
+    // Mutual information in bits, 0 if either attribute is not enum interpretable or the
+    // joint counts of the pair are not kept
+    double GetMutualInfo(size_t attr_a, size_t attr_b) const;
+    // The predictors of each attribute always precede it in ordered_attr_list
+    void Learn(std::vector<size_t>* ordered_attr_list,
+               std::vector< std::vector<size_t> >* predictor_list) const;
+};
+
+}  // namespace db_compress
+
+#endif
@@ -0,0 +1,143 @@
+#include "base.h"
+#include "model.h"
+#include "mutual_info_learner.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <iostream>
+
+namespace db_compress {
+
+class MockAttr : public AttrValue {
+  private:
+    int val_;
+  public:
+    MockAttr() : val_(0) {}
+    MockAttr(int val) : val_(val) {}
+    int Val() const { return val_; }
+};
+
+class MockInterpreter : public AttrInterpreter {
+  public:
+    bool EnumInterpretable() const { return true; }
+    int EnumCap() const { return 4; }
+    int EnumInterpret(const AttrValue* attr) const {
+        return static_cast<const MockAttr*>(attr)->Val();
+    }
+};
+
+// Too many values for the joint counts of two such attributes to be kept
+class LargeMockInterpreter : public AttrInterpreter {
+  public:
+    bool EnumInterpretable() const { return true; }
+    int EnumCap() const { return 1 << 20; }
+    int EnumInterpret(const AttrValue* attr) const {
+        return static_cast<const MockAttr*>(attr)->Val();
+    }
+};
+
+Schema schema;
+std::vector<MockAttr> attr;
+std::vector<Tuple> tuples;
+
+/*
+ * Attribute 1 is a copy of attribute 0, attribute 2 is a noisy copy of attribute 1,
+ * attribute 3 is independent and attribute 4 is not enum interpretable.
+ */
+void PrepareData() {
+    std::vector<int> attr_type(5, 0);
+    attr_type[4] = 1;
+    schema = Schema(attr_type);
+    RegisterAttrInterpreter(0, new MockInterpreter());
+    RegisterAttrInterpreter(2, new LargeMockInterpreter());
+    srand(0);
+    for (int i = 0; i < 4000; ++i) {
+        int a = rand() % 4;
+        attr.push_back(MockAttr(a));
+        attr.push_back(MockAttr(a));
+        attr.push_back(MockAttr(rand() % 10 == 0 ? rand() % 4 : a));
+        attr.push_back(MockAttr(rand() % 4));
+        attr.push_back(MockAttr(0));
+    }
+    tuples.resize(4000, Tuple(5));
+    for (int i = 0; i < 4000; ++i)
+    for (int j = 0; j < 5; ++j)
+        tuples[i].attr[j] = &attr[i * 5 + j];
+}
+
+void TestMutualInfo() {
+    MutualInfoLearner learner(schema, 1, -1);
+    MutualInfoLearner parallel_learner(schema, 1, -1);
+    for (size_t i = 0; i < tuples.size(); ++i)
+        learner.FeedTuple(tuples[i]);
+    parallel_learner.FeedTuples(tuples, 3);
+    if (learner.GetMutualInfo(0, 1) < 1.9 || learner.GetMutualInfo(0, 1) > 2)
+        std::cerr << "Mutual Info Unit Test Failed!\n";
+    if (learner.GetMutualInfo(0, 2) >= learner.GetMutualInfo(0, 1) ||
+        learner.GetMutualInfo(0, 2) != learner.GetMutualInfo(2, 1))
+        std::cerr << "Mutual Info Unit Test Failed!\n";
+    if (learner.GetMutualInfo(0, 3) > 0.01 || learner.GetMutualInfo(0, 4) != 0)
+        std::cerr << "Mutual Info Unit Test Failed!\n";
+    for (int i = 0; i < 5; ++i)
+    for (int j = 0; j < 5; ++j)
+    if (learner.GetMutualInfo(i, j) != parallel_learner.GetMutualInfo(i, j))
+        std::cerr << "Mutual Info Unit Test Failed!\n";
+}
+
+void TestLearn() {
+    int root[3] = {-1, -1, 3};
+    size_t max_predictors[3] = {1, 2, 1};
+    size_t expected_order[3][5] = {{0, 1, 2, 3, 4}, {0, 1, 2, 3, 4}, {3, 0, 1, 2, 4}};
+    for (int test = 0; test < 3; ++test) {
+        MutualInfoLearner learner(schema, max_predictors[test], root[test]);
+        for (size_t i = 0; i < tuples.size(); ++i)
+            learner.FeedTuple(tuples[i]);
+        std::vector<size_t> order;
+        std::vector< std::vector<size_t> > predictors;
+        learner.Learn(&order, &predictors);
+        if (order.size() != 5 || predictors.size() != 5)
+            std::cerr << "Mutual Info Learn Unit Test Failed!\n";
+        for (int i = 0; i < 5; ++i)
+        if (order[i] != expected_order[test][i])
+            std::cerr << "Mutual Info Learn Unit Test Failed!\n";
+        // The tree parent comes first, ties are broken by the order of joining the tree
+        if (predictors[0].size() != 0 || predictors[1] != std::vector<size_t>(1, 0) ||
+            predictors[2].size() != max_predictors[test] || predictors[2][0] != 0 ||
+            predictors[3].size() != 0 || predictors[4].size() != 0)
+            std::cerr << "Mutual Info Learn Unit Test Failed!\n";
+    }
+}
+
+void TestLargePair() {
+    // Attributes 0 and 1 are identical, but their 2^40 joint counts would not be allocated
+    std::vector<int> attr_type(3, 2);
+    attr_type[2] = 0;
+    std::vector<MockAttr> large_attr;
+    for (int i = 0; i < 100; ++i) {
+        large_attr.push_back(MockAttr(i * 1000));
+        large_attr.push_back(MockAttr(i * 1000));
+        large_attr.push_back(MockAttr(i % 4));
+    }
+    std::vector<Tuple> large_tuples(100, Tuple(3));
+    for (int i = 0; i < 100; ++i)
+    for (int j = 0; j < 3; ++j)
+        large_tuples[i].attr[j] = &large_attr[i * 3 + j];
+    MutualInfoLearner learner(Schema(attr_type), 1, -1);
+    learner.FeedTuples(large_tuples, 2);
+    if (learner.GetMutualInfo(0, 1) != 0 || learner.GetMutualInfo(0, 2) < 1.9)
+        std::cerr << "Mutual Info Large Pair Unit Test Failed!\n";
+}
+
+void Test() {
+    PrepareData();
+    TestMutualInfo();
+    TestLearn();
+    TestLargePair();
+}
+
+}  // namespace db_compress
+
+int main() {
+    db_compress::Test();
+}
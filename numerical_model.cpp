@@ -21,17 +21,168 @@ std::vector<size_t> GetPredictorCap(const Schema& schema, const std::vector<size
     return cap;
 }
 
+// Return the number of cells of the dense table, or 0 if some predictor is not enum
+// interpretable. The product saturates at limit + 1.
+unsigned long long GetTableSize(const Schema& schema, const std::vector<size_t>& predictor,
+                                unsigned long long limit) {
+    unsigned long long table_size = 1;
+    for (size_t i = 0; i < predictor.size(); ++i) {
+        int attr_type = schema.attr_type[predictor[i]];
+        if (!GetAttrInterpreter(attr_type)->EnumInterpretable())
+            return 0;
+        unsigned long long cap = GetAttrInterpreter(attr_type)->EnumCap();
+        if (cap > 0 && table_size > limit / cap)
+            return limit + 1;
+        table_size *= cap;
+    }
+    return table_size;
+}
+
+bool IsEnumInterpretable(const Schema& schema, const std::vector<size_t>& predictor) {
+    for (size_t i = 0; i < predictor.size(); ++i)
+    if (!GetAttrInterpreter(schema.attr_type[predictor[i]])->EnumInterpretable())
+        return false;
+    return true;
+}
+
+/*
+ * The branch probabilities of LaplaceSquID with the given mean_abs_dev, which are either
+ * computed at each branch or looked up in LaplaceBranchTable
+ */
+// The probability of each side of the center bin
+Prob GetCenterBranchProb(double dev, double bin_size) {
+    double p = GetCDFExponential(dev, bin_size / 2) / 2;
+    Prob prob = GetProb(p);
+    if (prob == GetZeroProb())
+        prob = GetProb(1, 16);
+    if (prob == GetProb(1,1))
+        prob = GetProb(32767, 16);
+    return prob;
+}
+
+// The number of bins of each step along the tails
+int GetTailWidth(double dev, double bin_size) { return ceil(dev / bin_size); }
+
+// The probability that a value in the tail lies within the next step
+Prob GetTailBranchProb(double dev, double bin_size, int width) {
+    return GetProb(GetCDFExponential(dev, width * bin_size));
+}
+
+// The probability that a value in a bounded interval of the given number of bins lies
+// within the half closer to the center
+Prob GetBoundedBranchProb(double dev, double bin_size, int width) {
+    int mid = width / 2;
+    return GetProb(GetCDFExponential(dev, mid * bin_size) /
+                   GetCDFExponential(dev, width * bin_size));
+}
+
+/*
+ * A value outside the center bin takes the steps of mean_abs_dev away from the center,
+ * which is 1 / (1 - 1 / e) steps on average for the Laplace distribution, followed by
+ * a binary search among the bins of one step.
+ */
+int EndOfCell(LaplaceStatsList* learning_stats, size_t cell, double bin_size,
+              double lookup_cost, LaplaceStats* stat, double* model_cost,
+              double* decode_cost) {
+    int count = learning_stats->End(cell, bin_size, stat);
+    *decode_cost += count * lookup_cost;
+    if (stat->mean_abs_dev != 0) {
+        *model_cost += count * (log2(stat->mean_abs_dev) + 1
+                                + log2(EulerConstant) - log2(bin_size));
+        double outside = exp(-bin_size / 2 / stat->mean_abs_dev);
+        double bins = std::max(ceil(stat->mean_abs_dev / bin_size), 1.0);
+        *decode_cost += count *
+            (1 + outside * (1 / (1 - 1 / EulerConstant) + log2(bins)));
+    }
+    return count;
+}
+
+void WriteCell(const LaplaceStats& stat, ByteWriter* byte_writer, size_t block_index) {
+    unsigned char bytes[4];
+    ConvertSinglePrecision(stat.median, bytes);
+    byte_writer->Write32Bit(bytes, block_index);
+    ConvertSinglePrecision(stat.mean_abs_dev, bytes);
+    byte_writer->Write32Bit(bytes, block_index);
+}
+
+void ReadCell(ByteReader* byte_reader, LaplaceStats* stat) {
+    unsigned char bytes[4];
+    byte_reader->Read32Bit(bytes);
+    stat->median = ConvertSinglePrecision(bytes);
+    byte_reader->Read32Bit(bytes);
+    stat->mean_abs_dev = ConvertSinglePrecision(bytes);
+}
+
+/*
+ * Moving the median of count values up by d adds d to the deviation of each value no
+ * larger than the old median and subtracts d from each value no smaller than the new one.
+ * The values strictly between the two medians are taken as Laplace distributed with the
+ * current mean absolute deviation b, which adds count * (d - b * (1 - exp(-d / b))).
+ */
+void MoveMedian(double d, int count, double* sum_abs_dev, int* num_of_above,
+                int* num_of_below) {
+    if (d == 0 || count == 0)
+        return;
+    double dev = *sum_abs_dev / count;
+    double between = (dev > 0 ? fabs(d) - dev * (1 - exp(-fabs(d) / dev)) : 0);
+    if (d > 0) {
+        *sum_abs_dev += d * (count - 2 * *num_of_above) + count * between;
+        *num_of_below = count - *num_of_above;
+    } else {
+        *sum_abs_dev -= d * (count - 2 * *num_of_below) - count * between;
+        *num_of_above = count - *num_of_below;
+    }
+    if (*sum_abs_dev < 0)
+        *sum_abs_dev = 0;
+}
+
 }  // anonymous namespace
 
 LaplaceSquID::LaplaceSquID(double bin_size, bool target_int) :
     target_int_(target_int),
     bin_size_(bin_size) {}
 
-inline void LaplaceSquID::Init(const LaplaceStats& stats) {
+void LaplaceBranchTable::Build(const std::vector<const LaplaceStats*>& cells,
+                               double bin_size) {
+    row_size_ = 0;
+    table_.clear();
+    if (bin_size <= 0)
+        return;
+    // The bounded intervals have at least two bins until width >> depth is 0
+    int depth = 0;
+    for (size_t i = 0; i < cells.size(); ++i)
+    if (cells[i]->mean_abs_dev != 0) {
+        int width = GetTailWidth(cells[i]->mean_abs_dev, bin_size);
+        while (depth < max_depth_ && (width >> depth) > 0)
+            ++ depth;
+    }
+    row_size_ = 3 + depth * 2;
+    table_.assign(cells.size() * row_size_, 0);
+    for (size_t i = 0; i < cells.size(); ++i) {
+        double dev = cells[i]->mean_abs_dev;
+        if (dev == 0)
+            continue;
+        int* row = &table_[i * row_size_];
+        int width = GetTailWidth(dev, bin_size);
+        row[0] = GetCenterBranchProb(dev, bin_size).num;
+        row[1] = GetTailBranchProb(dev, bin_size, width).num;
+        row[2] = width;
+        for (int d = 0; d < depth; ++d)
+        for (int j = 0; j < 2; ++j)
+        if ((width >> d) + j >= 2)
+            row[3 + d * 2 + j] = GetBoundedBranchProb(dev, bin_size, (width >> d) + j).num;
+    }
+}
+
+inline void LaplaceSquID::Init(const LaplaceStats& stats, const int* branch_prob,
+                               int branch_depth) {
     mean_ = stats.median;
     dev_ = stats.mean_abs_dev;
     l_ = r_ = 0;
     l_inf_ = r_inf_ = true;
+    branch_prob_ = branch_prob;
+    branch_depth_ = branch_depth;
+    depth_ = 0;
 }
 
 bool LaplaceSquID::HasNextBranch() const {
@@ -39,51 +190,54 @@ bool LaplaceSquID::HasNextBranch() const {
     return !(r_ == l_ && !l_inf_ && !r_inf_);
 }
 
+/*
+ * The bounded interval reached after d halvings of the first bounded interval, which has
+ * the tail width w, has either w >> d or (w >> d) + 1 bins.
+ */
 void LaplaceSquID::GenerateNextBranch() {
     if (l_inf_ && r_inf_) {
         // Initial Branch
-        prob_segs_ = std::vector<Prob>(2);
-        double p = GetCDFExponential(dev_, bin_size_ / 2) / 2;
-        Prob prob = GetProb(p);
-        if (prob == GetZeroProb())
-            prob = GetProb(1, 16);
-        if (prob == GetProb(1,1))
-            prob = GetProb(32767, 16);
-        prob_segs_[0] = GetProb(1, 1) - prob;
-        prob_segs_[1] = GetProb(1, 1) + prob;
+        Prob prob = (branch_prob_ != NULL ? GetProb(branch_prob_[0], 16)
+                                          : GetCenterBranchProb(dev_, bin_size_));
+        prob_buffer_[0] = GetProb(1, 1) - prob;
+        prob_buffer_[1] = GetProb(1, 1) + prob;
+        prob_segs_ = ProbSegs(prob_buffer_, 2);
     } else {
         Prob prob;
-        prob_segs_ = std::vector<Prob>(1);
+        bool reversed;
+        int mid;
         if (l_inf_ || r_inf_) {
-            int mid = ceil(dev_ / bin_size_);
-            double p = GetCDFExponential(dev_, mid * bin_size_);
-            if (l_inf_) {
-                // Reversed
-                prob = GetOneProb() - GetProb(p);
-                mid_ = r_ - mid;
+            if (branch_prob_ != NULL) {
+                mid = branch_prob_[2];
+                prob = GetProb(branch_prob_[1], 16);
             } else {
-                prob = GetProb(p);
-                mid_ = l_ + mid - 1;
+                mid = GetTailWidth(dev_, bin_size_);
+                prob = GetTailBranchProb(dev_, bin_size_, mid);
             }
+            reversed = l_inf_;
         } else {
-            int mid = (r_ - l_ + 1) / 2;
-            double p = GetCDFExponential(dev_, mid * bin_size_) /
-                       GetCDFExponential(dev_, (r_ - l_ + 1) * bin_size_);
-            if (r_ < 0) {
-                // Reversed
-                prob = GetOneProb() - GetProb(p);
-                mid_ = r_ - mid;
-            } else {
-                prob = GetProb(p);
-                mid_ = l_ + mid - 1;
-            }
+            int width = r_ - l_ + 1;
+            mid = width / 2;
+            if (branch_prob_ != NULL && depth_ < branch_depth_)
+                prob = GetProb(branch_prob_[3 + depth_ * 2 + width -
+                                            (branch_prob_[2] >> depth_)], 16);
+            else
+                prob = GetBoundedBranchProb(dev_, bin_size_, width);
+            reversed = (r_ < 0);
+        }
+        if (reversed) {
+            prob = GetOneProb() - prob;
+            mid_ = r_ - mid;
+        } else {
+            mid_ = l_ + mid - 1;
         }
         // In extreme cases, prob might be 0 or 1
         if (prob == GetOneProb())
             prob = GetProb(65535, 16);
         if (prob == GetZeroProb())
             prob = GetProb(1, 16);
-        prob_segs_[0] = prob;
+        prob_buffer_[0] = prob;
+        prob_segs_ = ProbSegs(prob_buffer_, 1);
     }
 }
 
@@ -118,6 +272,8 @@ void LaplaceSquID::ChooseNextBranch(int branch) {
             SetLeft(1);
         }
     } else {
+        if (!l_inf_ && !r_inf_)
+            ++ depth_;
         if (branch == 0) {
             SetRight(mid_);
         } else {
@@ -138,95 +294,185 @@ const AttrValue* LaplaceSquID::GetResultAttr() {
     } else return NULL;
 }
 
-void LaplaceStats::PushValue(double value) {
-    if (count == 0) {
-        values.push_back(value);
-        if (values.size() > 20)
-            GetMedian(); 
+void LaplaceStatsList::Resize(size_t size) {
+    count_.resize(size);
+    median_.resize(size);
+    sum_abs_dev_.resize(size);
+    num_of_above_.resize(size);
+    num_of_below_.resize(size);
+    buffer_pos_.resize(size, -1);
+}
+
+void LaplaceStatsList::PushValue(size_t cell, double value) {
+    if (IsBuffering(cell)) {
+        if (buffer_pos_[cell] == -1) {
+            buffer_pos_[cell] = buffer_.size();
+            buffer_.resize(buffer_.size() + kNumOfMedianValues);
+        }
+        buffer_[buffer_pos_[cell] + count_[cell]] = value;
+        if (++ count_[cell] == kNumOfMedianValues)
+            EstimateMedian(cell);
     } else {
-        ++ count;
-        sum_abs_dev += fabs(value - median);
+        ++ count_[cell];
+        sum_abs_dev_[cell] += fabs(value - median_[cell]);
+        if (value > median_[cell])
+            ++ num_of_above_[cell];
+        else if (value < median_[cell])
+            ++ num_of_below_[cell];
     }
 }
 
-void LaplaceStats::End(double bin_size) {
-    if (values.size() > 0)
-        GetMedian();
-    if (sum_abs_dev < bin_size)
-        mean_abs_dev = 0;
+/*
+ * The median is estimated from the first few values, and the absolute deviations of the
+ * later values are accumulated against it. Values that are still buffered can simply be
+ * pushed, which is exact when the other statistics hold the later values. Otherwise both
+ * sums are moved to the median of the larger part (the smaller median on ties, so that
+ * the result does not depend on the order of merging), see MoveMedian.
+ */
+void LaplaceStatsList::Merge(size_t cell, const LaplaceStatsList& other, size_t other_cell) {
+    if (other.IsBuffering(other_cell)) {
+        for (int i = 0; i < other.count_[other_cell]; ++i)
+            PushValue(cell, other.buffer_[other.buffer_pos_[other_cell] + i]);
+        return;
+    }
+    if (!IsBuffering(cell)) {
+        int count = count_[cell], other_count = other.count_[other_cell];
+        double median = median_[cell], other_median = other.median_[other_cell];
+        double merged_median = (other_count > count ||
+                                (other_count == count && other_median < median) ?
+                                other_median : median);
+        MoveMedian(merged_median - median, count, &sum_abs_dev_[cell],
+                   &num_of_above_[cell], &num_of_below_[cell]);
+        double other_sum = other.sum_abs_dev_[other_cell];
+        int other_above = other.num_of_above_[other_cell];
+        int other_below = other.num_of_below_[other_cell];
+        MoveMedian(merged_median - other_median, other_count, &other_sum,
+                   &other_above, &other_below);
+        median_[cell] = merged_median;
+        sum_abs_dev_[cell] += other_sum;
+        num_of_above_[cell] += other_above;
+        num_of_below_[cell] += other_below;
+        count_[cell] += other_count;
+        return;
+    }
+    int num_of_buffered = count_[cell];
+    median_[cell] = other.median_[other_cell];
+    count_[cell] = other.count_[other_cell];
+    sum_abs_dev_[cell] = other.sum_abs_dev_[other_cell];
+    num_of_above_[cell] = other.num_of_above_[other_cell];
+    num_of_below_[cell] = other.num_of_below_[other_cell];
+    for (int i = 0; i < num_of_buffered; ++i)
+        PushValue(cell, buffer_[buffer_pos_[cell] + i]);
+}
+
+int LaplaceStatsList::End(size_t cell, double bin_size, LaplaceStats* stats) {
+    if (IsBuffering(cell) && count_[cell] > 0)
+        EstimateMedian(cell);
+    stats->median = median_[cell];
+    if (sum_abs_dev_[cell] < bin_size)
+        stats->mean_abs_dev = 0;
     else
-        mean_abs_dev = sum_abs_dev / count;
-    QuantizationToFloat32Bit(&mean_abs_dev);
-    QuantizationToFloat32Bit(&median);
+        stats->mean_abs_dev = sum_abs_dev_[cell] / count_[cell];
+    QuantizationToFloat32Bit(&stats->mean_abs_dev);
+    QuantizationToFloat32Bit(&stats->median);
+    return count_[cell];
+}
+
+void LaplaceStatsList::EstimateMedian(size_t cell) {
+    double* values = &buffer_[buffer_pos_[cell]];
+    int count = count_[cell];
+    std::sort(values, values + count);
+    median_[cell] = values[count / 2];
+    for (int i = 0; i < count; ++i) {
+        sum_abs_dev_[cell] += fabs(values[i] - median_[cell]);
+        if (values[i] > median_[cell])
+            ++ num_of_above_[cell];
+        else if (values[i] < median_[cell])
+            ++ num_of_below_[cell];
+    }
 }
 
-void LaplaceStats::GetMedian() {
-    sort(values.begin(), values.end());
-    median = values[values.size() / 2];
-    count = values.size();
-    for (size_t i = 0; i < values.size(); ++i)
-        sum_abs_dev += fabs(values[i] - median);
-    values.clear();
+void LaplaceStatsList::Clear() {
+    std::vector<int>().swap(count_);
+    std::vector<double>().swap(median_);
+    std::vector<double>().swap(sum_abs_dev_);
+    std::vector<int>().swap(num_of_above_);
+    std::vector<int>().swap(num_of_below_);
+    std::vector<int>().swap(buffer_pos_);
+    std::vector<double>().swap(buffer_);
 }
 
 TableLaplace::TableLaplace(const Schema& schema, 
                            const std::vector<size_t>& predictor_list, 
                            size_t target_var,
                            double err,
-                           bool target_int) : 
+                           bool target_int,
+                           int max_branch_depth) : 
     SquIDModel(predictor_list, target_var), 
     predictor_interpreter_(predictor_list_.size()),
     target_int_(target_int),
     bin_size_( (target_int_ ? floor(err) * 2 + 1 : err * 2) ),
     model_cost_(0),
+    decode_cost_(0),
     dynamic_list_(GetPredictorCap(schema, predictor_list)),
-    squid_(bin_size_, target_int_) {
+    learning_stats_(dynamic_list_.size()),
+    branch_table_(max_branch_depth) {
     QuantizationToFloat32Bit(&bin_size_);
     for (size_t i = 0; i < predictor_list_.size(); ++i)
         predictor_interpreter_[i] = GetAttrInterpreter(schema.attr_type[predictor_list_[i]]);
 }
 
-SquID* TableLaplace::GetSquID(const Tuple& tuple) {
-    std::vector<size_t> index;
-    GetDynamicListIndex(tuple, &index);
-    squid_.Init(dynamic_list_[index]);
-    return &squid_;
+void TableLaplace::InitSquID(const Tuple& tuple, SquID* squid) const {
+    size_t pos = GetDynamicListPos(tuple);
+    static_cast<LaplaceSquID*>(squid)->Init(dynamic_list_[pos], branch_table_.GetRow(pos),
+                                            branch_table_.GetDepth());
 }
 
-void TableLaplace::GetDynamicListIndex(const Tuple& tuple, std::vector<size_t>* index) {
-    index->clear();
-    for (size_t i = 0; i < predictor_list_.size(); ++i ) {
-        const AttrValue* attr = tuple.attr[predictor_list_[i]];
-        size_t val = predictor_interpreter_[i]->EnumInterpret(attr);
-        index->push_back(val);
-    }
+void TableLaplace::BuildBranchTable() {
+    std::vector<const LaplaceStats*> cells;
+    for (size_t i = 0; i < dynamic_list_.size(); ++i)
+        cells.push_back(&dynamic_list_[i]);
+    branch_table_.Build(cells, bin_size_);
+}
+
+size_t TableLaplace::GetDynamicListPos(const Tuple& tuple) const {
+    return dynamic_list_.GetPos([&](size_t i) -> size_t {
+        return predictor_interpreter_[i]->EnumInterpret(tuple.attr[predictor_list_[i]]);
+    });
 }
 
 void TableLaplace::FeedTuple(const Tuple& tuple) {
-    std::vector<size_t> predictors;
-    GetDynamicListIndex(tuple, &predictors);
     double target_val;
     const AttrValue* attr = tuple.attr[target_var_];
     if (target_int_)
         target_val = static_cast<const IntegerAttrValue*>(attr)->Value();
     else
         target_val = static_cast<const DoubleAttrValue*>(attr)->Value();
-    LaplaceStats& stat = dynamic_list_[predictors];
-    stat.PushValue(target_val);
+    learning_stats_.PushValue(GetDynamicListPos(tuple), target_val);
+}
+
+void TableLaplace::Merge(const SquIDModel& model) {
+    const TableLaplace& other = static_cast<const TableLaplace&>(model);
+    for (size_t i = 0; i < dynamic_list_.size(); ++i )
+        learning_stats_.Merge(i, other.learning_stats_, i);
 }
 
 void TableLaplace::EndOfData() {
-    for (size_t i = 0; i < dynamic_list_.size(); ++i ) {
-        LaplaceStats& stat = dynamic_list_[i];
-        stat.End(bin_size_);
-        if (stat.mean_abs_dev != 0) {
-            model_cost_ += stat.count * (log2(stat.mean_abs_dev) + 1 
-                                         + log2(EulerConstant) - log2(bin_size_));
-        }
-    }
+    double lookup_cost = GetTableLookupCost(predictor_list_.size(),
+                                            dynamic_list_.size() * sizeof(LaplaceStats));
+    for (size_t i = 0; i < dynamic_list_.size(); ++i )
+        EndOfCell(&learning_stats_, i, bin_size_, lookup_cost, &dynamic_list_[i],
+                  &model_cost_, &decode_cost_);
+    learning_stats_.Clear();
+    BuildBranchTable();
     model_cost_ += GetModelDescriptionLength();
 }
 
+size_t TableLaplace::GetMemoryFootprint() const {
+    size_t cell_bytes = sizeof(LaplaceStats) + LaplaceStatsList::GetBytesPerCell();
+    return dynamic_list_.size() * cell_bytes;
+}
+
 int TableLaplace::GetModelDescriptionLength() const {
     size_t table_size = dynamic_list_.size();;
     // See WriteModel function for details of model description.
@@ -245,76 +491,269 @@ void TableLaplace::WriteModel(ByteWriter* byte_writer,
 
     // Write Model Parameters
     size_t table_size = dynamic_list_.size();
-    for (size_t i = 0; i < table_size; ++i ) {
-        const LaplaceStats& stat = dynamic_list_[i];
-        ConvertSinglePrecision(stat.median, bytes);
-        byte_writer->Write32Bit(bytes, block_index);
-        ConvertSinglePrecision(stat.mean_abs_dev, bytes);
-        byte_writer->Write32Bit(bytes, block_index);
-    }
+    for (size_t i = 0; i < table_size; ++i )
+        WriteCell(dynamic_list_[i], byte_writer, block_index);
 }
 
 SquIDModel* TableLaplace::ReadModel(ByteReader* byte_reader, 
-                               const Schema& schema, size_t target_var, bool target_int) {
+                               const Schema& schema, size_t target_var, bool target_int,
+                               int max_branch_depth) {
     size_t predictor_size = byte_reader->ReadByte();
     std::vector<size_t> predictor_list;
     for (size_t i = 0; i < predictor_size; ++i )
         predictor_list.push_back(byte_reader->Read16Bit());
-    TableLaplace* model = new TableLaplace(schema, predictor_list, target_var, 0, target_int);
+    TableLaplace* model = new TableLaplace(schema, predictor_list, target_var, 0, target_int,
+                                           max_branch_depth);
     unsigned char bytes[4];
     byte_reader->Read32Bit(bytes);
     model->bin_size_ = ConvertSinglePrecision(bytes);
-    model->squid_ = LaplaceSquID(model->bin_size_, target_int);
 
     // Write Model Parameters
     size_t table_size = model->dynamic_list_.size();
-    for (size_t i = 0; i < table_size; ++i ) {
-        LaplaceStats& stat = model->dynamic_list_[i];
-        byte_reader->Read32Bit(bytes);
-        stat.median = ConvertSinglePrecision(bytes);
-        byte_reader->Read32Bit(bytes);
-        stat.mean_abs_dev = ConvertSinglePrecision(bytes);
-    }
+    for (size_t i = 0; i < table_size; ++i )
+        ReadCell(byte_reader, &model->dynamic_list_[i]);
+    model->BuildBranchTable();
     
     return model;    
 }
 
 SquIDModel* TableLaplaceRealCreator::ReadModel(ByteReader* byte_reader, 
                                           const Schema& schema, size_t index) {
-    return TableLaplace::ReadModel(byte_reader, schema, index, false);
+    return TableLaplace::ReadModel(byte_reader, schema, index, false, max_branch_depth_);
 }
 
 SquIDModel* TableLaplaceRealCreator::CreateModel(const Schema& schema,
             const std::vector<size_t>& predictor, size_t index, double err) {
-    size_t table_size = 1;
-    for (size_t i = 0; i < predictor.size(); ++i) {
-        int attr_type = schema.attr_type[predictor[i]];
-        if (!GetAttrInterpreter(attr_type)->EnumInterpretable())
-            return NULL;
-        table_size *= GetAttrInterpreter(attr_type)->EnumCap();
-    }
-    if (table_size > MAX_TABLE_SIZE)
+    if (!IsEnumInterpretable(schema, predictor))
+        return NULL;
+    if (GetTableSize(schema, predictor, MAX_TABLE_SIZE) > MAX_TABLE_SIZE)
         return NULL;
-    return new TableLaplace(schema, predictor, index, err, false);
+    return new TableLaplace(schema, predictor, index, err, false, max_branch_depth_);
 }
 
 SquIDModel* TableLaplaceIntCreator::ReadModel(ByteReader* byte_reader, 
                                          const Schema& schema, size_t index) {
-    return TableLaplace::ReadModel(byte_reader, schema, index, true);
+    return TableLaplace::ReadModel(byte_reader, schema, index, true, max_branch_depth_);
 }
 
 SquIDModel* TableLaplaceIntCreator::CreateModel(const Schema& schema,
             const std::vector<size_t>& predictor, size_t index, double err) {
-    size_t table_size = 1;
-    for (size_t i = 0; i < predictor.size(); ++i) {
-        int attr_type = schema.attr_type[predictor[i]];
-        if (!GetAttrInterpreter(attr_type)->EnumInterpretable())
-            return NULL;
-        table_size *= GetAttrInterpreter(attr_type)->EnumCap();
+    if (!IsEnumInterpretable(schema, predictor))
+        return NULL;
+    if (GetTableSize(schema, predictor, MAX_TABLE_SIZE) > MAX_TABLE_SIZE)
+        return NULL;
+    return new TableLaplace(schema, predictor, index, err, true, max_branch_depth_);
+}
+
+SparseTableLaplace::SparseTableLaplace(const Schema& schema,
+                                       const std::vector<size_t>& predictor_list,
+                                       size_t target_var,
+                                       double err,
+                                       bool target_int,
+                                       size_t max_num_of_cells,
+                                       int max_branch_depth) :
+    SquIDModel(predictor_list, target_var),
+    predictor_interpreter_(predictor_list_.size()),
+    target_int_(target_int),
+    bin_size_( (target_int_ ? floor(err) * 2 + 1 : err * 2) ),
+    model_cost_(0),
+    decode_cost_(0),
+    max_num_of_cells_(max_num_of_cells),
+    sparse_list_(GetPredictorCap(schema, predictor_list),
+                 max_num_of_cells * kSparseLearningFactor),
+    learning_stats_(0),
+    fallback_learning_stats_(1),
+    num_of_fallback_tuples_(0),
+    branch_table_(max_branch_depth) {
+    QuantizationToFloat32Bit(&bin_size_);
+    for (size_t i = 0; i < predictor_list_.size(); ++i)
+        predictor_interpreter_[i] = GetAttrInterpreter(schema.attr_type[predictor_list_[i]]);
+}
+
+size_t SparseTableLaplace::GetSparseListPos(const Tuple& tuple) const {
+    return sparse_list_.GetPos([&](size_t i) -> size_t {
+        return predictor_interpreter_[i]->EnumInterpret(tuple.attr[predictor_list_[i]]);
+    });
+}
+
+void SparseTableLaplace::InitSquID(const Tuple& tuple, SquID* squid) const {
+    const LaplaceStats* stat = sparse_list_.Find(GetSparseListPos(tuple));
+    size_t row = (stat == NULL ? sparse_list_.size() : sparse_list_.GetIndexOfCell(stat));
+    static_cast<LaplaceSquID*>(squid)->Init(stat == NULL ? fallback_ : *stat,
+        branch_table_.GetRow(row), branch_table_.GetDepth());
+}
+
+void SparseTableLaplace::BuildBranchTable() {
+    std::vector<const LaplaceStats*> cells;
+    for (size_t i = 0; i < sparse_list_.size(); ++i)
+        cells.push_back(&sparse_list_[i]);
+    cells.push_back(&fallback_);
+    branch_table_.Build(cells, bin_size_);
+}
+
+void SparseTableLaplace::FeedTuple(const Tuple& tuple) {
+    double target_val;
+    const AttrValue* attr = tuple.attr[target_var_];
+    if (target_int_)
+        target_val = static_cast<const IntegerAttrValue*>(attr)->Value();
+    else
+        target_val = static_cast<const DoubleAttrValue*>(attr)->Value();
+    LaplaceStats* stat = sparse_list_.Insert(GetSparseListPos(tuple));
+    if (stat != NULL)
+        learning_stats_.PushValue(GetLearningStatsIndex(stat), target_val);
+    else
+        ++ num_of_fallback_tuples_;
+    fallback_learning_stats_.PushValue(0, target_val);
+}
+
+size_t SparseTableLaplace::GetLearningStatsIndex(const LaplaceStats* stat) {
+    if (learning_stats_.size() < sparse_list_.size())
+        learning_stats_.Resize(sparse_list_.size());
+    return sparse_list_.GetIndexOfCell(stat);
+}
+
+void SparseTableLaplace::Merge(const SquIDModel& model) {
+    const SparseTableLaplace& other = static_cast<const SparseTableLaplace&>(model);
+    for (size_t i = 0; i < other.sparse_list_.size(); ++i ) {
+        LaplaceStats* stat = sparse_list_.Insert(other.sparse_list_.GetPosOfCell(i));
+        if (stat != NULL)
+            learning_stats_.Merge(GetLearningStatsIndex(stat), other.learning_stats_, i);
+        else
+            num_of_fallback_tuples_ += other.learning_stats_.GetCount(i);
+    }
+    num_of_fallback_tuples_ += other.num_of_fallback_tuples_;
+    fallback_learning_stats_.Merge(0, other.fallback_learning_stats_, 0);
+}
+
+// The hash table takes the position and about two slots for each cell
+size_t SparseTableLaplace::GetMemoryFootprint() const {
+    return (max_num_of_cells_ * kSparseLearningFactor + 1) *
+           (sizeof(LaplaceStats) + LaplaceStatsList::GetBytesPerCell() + 2 * sizeof(size_t));
+}
+
+// The tuples of the cells dropped are coded with the fallback cell, which learned them
+void SparseTableLaplace::KeepMostFrequentCells() {
+    if (sparse_list_.size() <= max_num_of_cells_)
+        return;
+    std::vector<size_t> index = sparse_list_.GetMostFrequentCells(max_num_of_cells_,
+        [this](size_t i) { return learning_stats_.GetCount(i); });
+    LaplaceStatsList learning_stats(index.size());
+    for (size_t i = 0; i < index.size(); ++i)
+        learning_stats.Merge(i, learning_stats_, index[i]);
+    for (size_t i = 0; i < sparse_list_.size(); ++i)
+        num_of_fallback_tuples_ += learning_stats_.GetCount(i);
+    for (size_t i = 0; i < index.size(); ++i)
+        num_of_fallback_tuples_ -= learning_stats.GetCount(i);
+    learning_stats_ = std::move(learning_stats);
+    sparse_list_.Retain(index);
+}
+
+/*
+ * Same as SparseTableCategorical, the tuples learned without a cell are charged the
+ * average cost of the fallback cell, and the cells are sorted after their parameters are
+ * set from learning_stats_.
+ */
+void SparseTableLaplace::EndOfData() {
+    KeepMostFrequentCells();
+    double lookup_cost = GetTableLookupCost(predictor_list_.size() + 1,
+        (sparse_list_.size() + 1) * (sizeof(LaplaceStats) + sizeof(size_t)));
+    for (size_t i = 0; i < sparse_list_.size(); ++i )
+        EndOfCell(&learning_stats_, i, bin_size_, lookup_cost, &sparse_list_[i],
+                  &model_cost_, &decode_cost_);
+    double fallback_cost = 0, fallback_decode_cost = 0;
+    int fallback_count = EndOfCell(&fallback_learning_stats_, 0, bin_size_, lookup_cost,
+                                   &fallback_, &fallback_cost, &fallback_decode_cost);
+    if (fallback_count > 0) {
+        model_cost_ += fallback_cost * num_of_fallback_tuples_ / fallback_count;
+        decode_cost_ += fallback_decode_cost * num_of_fallback_tuples_ / fallback_count;
     }
-    if (table_size > MAX_TABLE_SIZE)
+    learning_stats_.Clear();
+    fallback_learning_stats_.Clear();
+    sparse_list_.Sort();
+    BuildBranchTable();
+    model_cost_ += GetModelDescriptionLength();
+}
+
+int SparseTableLaplace::GetModelDescriptionLength() const {
+    // See WriteModel function for details of model description.
+    return sparse_list_.size() * 96 + 64 + predictor_list_.size() * 16 + 72;
+}
+
+/*
+ * The model description is the same as TableLaplace, except that the table consists of
+ * the number of cells, the position of each cell in the dense table followed by its
+ * parameters, and the parameters of the fallback cell.
+ */
+void SparseTableLaplace::WriteModel(ByteWriter* byte_writer,
+                                    size_t block_index) const {
+    unsigned char bytes[4];
+    byte_writer->WriteByte(predictor_list_.size(), block_index);
+    for (size_t i = 0; i < predictor_list_.size(); ++i )
+        byte_writer->Write16Bit(predictor_list_[i], block_index);
+
+    ConvertSinglePrecision(bin_size_, bytes);
+    byte_writer->Write32Bit(bytes, block_index);
+
+    byte_writer->WriteBits(sparse_list_.size(), 32, block_index);
+    for (size_t i = 0; i < sparse_list_.size(); ++i ) {
+        byte_writer->WriteBits(sparse_list_.GetPosOfCell(i), 32, block_index);
+        WriteCell(sparse_list_[i], byte_writer, block_index);
+    }
+    WriteCell(fallback_, byte_writer, block_index);
+}
+
+SquIDModel* SparseTableLaplace::ReadModel(ByteReader* byte_reader,
+                               const Schema& schema, size_t target_var, bool target_int,
+                               int max_branch_depth) {
+    size_t predictor_size = byte_reader->ReadByte();
+    std::vector<size_t> predictor_list;
+    for (size_t i = 0; i < predictor_size; ++i )
+        predictor_list.push_back(byte_reader->Read16Bit());
+    unsigned char bytes[4];
+    byte_reader->Read32Bit(bytes);
+    double bin_size = ConvertSinglePrecision(bytes);
+    size_t table_size = byte_reader->ReadBits(32);
+    SparseTableLaplace* model = new SparseTableLaplace(schema, predictor_list, target_var, 0,
+                                                       target_int, table_size,
+                                                       max_branch_depth);
+    model->bin_size_ = bin_size;
+    for (size_t i = 0; i < table_size; ++i ) {
+        size_t pos = byte_reader->ReadBits(32);
+        ReadCell(byte_reader, model->sparse_list_.Insert(pos));
+    }
+    ReadCell(byte_reader, &model->fallback_);
+    model->BuildBranchTable();
+    return model;
+}
+
+SquIDModel* SparseTableLaplaceRealCreator::ReadModel(ByteReader* byte_reader,
+                                                     const Schema& schema, size_t index) {
+    return SparseTableLaplace::ReadModel(byte_reader, schema, index, false,
+                                         max_branch_depth_);
+}
+
+SquIDModel* SparseTableLaplaceRealCreator::CreateModel(const Schema& schema,
+            const std::vector<size_t>& predictor, size_t index, double err) {
+    unsigned long long table_size = GetTableSize(schema, predictor, MAX_TABLE_SIZE);
+    if (table_size <= MIN_TABLE_SIZE || table_size > MAX_TABLE_SIZE)
+        return NULL;
+    return new SparseTableLaplace(schema, predictor, index, err, false, MAX_NUM_OF_CELLS,
+                                  max_branch_depth_);
+}
+
+SquIDModel* SparseTableLaplaceIntCreator::ReadModel(ByteReader* byte_reader,
+                                                    const Schema& schema, size_t index) {
+    return SparseTableLaplace::ReadModel(byte_reader, schema, index, true,
+                                         max_branch_depth_);
+}
+
+SquIDModel* SparseTableLaplaceIntCreator::CreateModel(const Schema& schema,
+            const std::vector<size_t>& predictor, size_t index, double err) {
+    unsigned long long table_size = GetTableSize(schema, predictor, MAX_TABLE_SIZE);
+    if (table_size <= MIN_TABLE_SIZE || table_size > MAX_TABLE_SIZE)
         return NULL;
-    return new TableLaplace(schema, predictor, index, err, true);
+    return new SparseTableLaplace(schema, predictor, index, err, true, MAX_NUM_OF_CELLS,
+                                  max_branch_depth_);
 }
 
 }  // namespace db_compress
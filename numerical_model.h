@@ -32,17 +32,77 @@ class DoubleAttrValue: public AttrValue {
 };
 
 struct LaplaceStats {
-  private:
-    void GetMedian();
-  public:
-    int count;
     double median;
-    double sum_abs_dev;
     double mean_abs_dev;
-    std::vector<double> values;
-    LaplaceStats() : count(0), median(0), sum_abs_dev(0) {}
-    void PushValue(double value);
-    void End(double bin_size);
+    LaplaceStats() : median(0), mean_abs_dev(0) {}
+};
+
+/*
+ * LaplaceStatsList accumulates the statistics of many cells in contiguous arrays. The
+ * median of each cell is estimated from its first kNumOfMedianValues values, which are
+ * buffered in blocks of one shared buffer, then only the absolute deviations of the later
+ * values from the median are summed up, along with the numbers of values above and below
+ * the median, which allow moving the sum to another median when merging.
+ */
+class LaplaceStatsList {
+  private:
+    static const int kNumOfMedianValues = 21;
+    std::vector<int> count_;
+    std::vector<double> median_;
+    std::vector<double> sum_abs_dev_;
+    std::vector<int> num_of_above_;
+    std::vector<int> num_of_below_;
+    // The first value of the block of each cell in buffer_, or -1 if no value is buffered
+    std::vector<int> buffer_pos_;
+    std::vector<double> buffer_;
+
+    bool IsBuffering(size_t cell) const { return count_[cell] < kNumOfMedianValues; }
+    void EstimateMedian(size_t cell);
+  public:
+    explicit LaplaceStatsList(size_t size) { Resize(size); }
+    void Resize(size_t size);
+    size_t size() const { return count_.size(); }
+    int GetCount(size_t cell) const { return count_[cell]; }
+    // The bytes of the statistics of one cell, including a full block of the buffer
+    static size_t GetBytesPerCell() {
+        return 4 * sizeof(int) + (2 + kNumOfMedianValues) * sizeof(double);
+    }
+    void PushValue(size_t cell, double value);
+    // Add the values of a cell of another list to the cell
+    void Merge(size_t cell, const LaplaceStatsList& other, size_t other_cell);
+    // Set the quantized parameters of the cell to stats, return the number of values
+    int End(size_t cell, double bin_size, LaplaceStats* stats);
+    // Release the memory of the statistics, the list is left with no cells
+    void Clear();
+};
+
+// The default maximum depth of LaplaceBranchTable
+const int kDefaultLaplaceBranchDepth = 12;
+
+/*
+ * LaplaceBranchTable precomputes the quantized branch probabilities of LaplaceSquID for
+ * the cells of a model, so that coding a value takes table lookups instead of exp(). The
+ * probabilities of a cell only depend on its mean_abs_dev and the bin size: the initial
+ * branch and all the steps along the tails are the same, and the bounded intervals reached
+ * after d halvings have one of two widths. Each row holds the initial branch, the tail
+ * step, the tail width and the two widths of each of the first depth halvings, where depth
+ * is at most max_depth. The deeper branches are computed as usual.
+ */
+class LaplaceBranchTable {
+  private:
+    int max_depth_;
+    size_t row_size_;
+    // The probabilities are stored as the numerators of base 16
+    std::vector<int> table_;
+  public:
+    explicit LaplaceBranchTable(int max_depth) : max_depth_(max_depth), row_size_(0) {}
+    // Build the rows of the given cells
+    void Build(const std::vector<const LaplaceStats*>& cells, double bin_size);
+    // Return NULL if the table is not built
+    const int* GetRow(size_t cell) const {
+        return (row_size_ == 0 ? NULL : &table_[cell * row_size_]);
+    }
+    int GetDepth() const { return (row_size_ == 0 ? 0 : (row_size_ - 3) / 2); }
 };
 
 class LaplaceSquID : public SquID {
@@ -53,6 +113,13 @@ class LaplaceSquID : public SquID {
     double mean_, dev_;
     int l_, r_, mid_;
     bool l_inf_, r_inf_;
+    // The storage viewed by prob_segs_
+    Prob prob_buffer_[2];
+    // The row of the LaplaceBranchTable, and the number of halvings of the bounded
+    // interval so far
+    const int* branch_prob_;
+    int branch_depth_;
+    int depth_;
 
     IntegerAttrValue int_attr_;
     DoubleAttrValue double_attr_;
@@ -61,7 +128,12 @@ class LaplaceSquID : public SquID {
     void SetRight(int r) { r_ = r; r_inf_ = false; }
   public:
     LaplaceSquID(double bin_size, bool target_int);
-    void Init(const LaplaceStats& stats);
+    // A copy of prob_segs_ would still view the prob_buffer_ of the original
+    LaplaceSquID(const LaplaceSquID&) = delete;
+    LaplaceSquID& operator=(const LaplaceSquID&) = delete;
+    // branch_prob is the row of the cell in a LaplaceBranchTable of the given depth, or
+    // NULL to compute all the branches
+    void Init(const LaplaceStats& stats, const int* branch_prob, int branch_depth);
     bool HasNextBranch() const;
     void GenerateNextBranch();
     int GetNextBranch(const AttrValue* attr) const;
@@ -75,29 +147,44 @@ class TableLaplace : public SquIDModel {
     bool target_int_;
     double bin_size_;
     double model_cost_;
+    double decode_cost_;
     DynamicList<LaplaceStats> dynamic_list_;
-    LaplaceSquID squid_;
+    // The statistics of each cell, only used in learning
+    LaplaceStatsList learning_stats_;
+    LaplaceBranchTable branch_table_;
 
-    void GetDynamicListIndex(const Tuple& tuple, std::vector<size_t>* index);
+    // The position of the cell of the tuple in dynamic_list_
+    size_t GetDynamicListPos(const Tuple& tuple) const;
+    void BuildBranchTable();
 
   public:
+    // See LaplaceBranchTable for max_branch_depth
     TableLaplace(const Schema& schema, const std::vector<size_t>& predictor_list,
-                  size_t target_var, double err, bool target_int);
-    SquID* GetSquID(const Tuple& tuple);
+                  size_t target_var, double err, bool target_int,
+                  int max_branch_depth = kDefaultLaplaceBranchDepth);
+    SquID* CreateSquID() const { return new LaplaceSquID(bin_size_, target_int_); }
+    void InitSquID(const Tuple& tuple, SquID* squid) const;
     int GetModelCost() const { return model_cost_; }
+    int64_t GetDecodeCost() const { return decode_cost_; }
+    size_t GetMemoryFootprint() const;
     void FeedTuple(const Tuple& tuple);
     void EndOfData();
+    void Merge(const SquIDModel& model);
 
     int GetModelDescriptionLength() const;
     void WriteModel(ByteWriter* byte_writer, size_t block_index) const;
     static SquIDModel* ReadModel(ByteReader* byte_reader, 
-                            const Schema& schema, size_t index, bool target_int);
+                            const Schema& schema, size_t index, bool target_int,
+                            int max_branch_depth = kDefaultLaplaceBranchDepth);
 };
 
 class TableLaplaceRealCreator : public ModelCreator {
   private:
     const size_t MAX_TABLE_SIZE = 1000;
+    int max_branch_depth_;
   public:
+    explicit TableLaplaceRealCreator(int max_branch_depth = kDefaultLaplaceBranchDepth) :
+        max_branch_depth_(max_branch_depth) {}
     SquIDModel* ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index);
     SquIDModel* CreateModel(const Schema& schema, const std::vector<size_t>& predictor_list,
                        size_t target_var, double err);
@@ -106,7 +193,104 @@ class TableLaplaceRealCreator : public ModelCreator {
 class TableLaplaceIntCreator : public ModelCreator {
   private:
     const size_t MAX_TABLE_SIZE = 1000;
+    int max_branch_depth_;
+  public:
+    explicit TableLaplaceIntCreator(int max_branch_depth = kDefaultLaplaceBranchDepth) :
+        max_branch_depth_(max_branch_depth) {}
+    SquIDModel* ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index);
+    SquIDModel* CreateModel(const Schema& schema, const std::vector<size_t>& predictor_list,
+                       size_t target_var, double err);
+};
+
+/*
+ * SparseTableLaplace is the variant of TableLaplace for predictors whose dense table would
+ * be too large. Only the observed combinations of predictor values have their own cells,
+ * which are kept in a SparseList of at most max_num_of_cells cells, while the combinations
+ * without cells share the fallback cell, which is learned from all the tuples. The cells
+ * are chosen by frequency the same way as SparseTableCategorical.
+ */
+class SparseTableLaplace : public SquIDModel {
+  private:
+    std::vector<const AttrInterpreter*> predictor_interpreter_;
+    bool target_int_;
+    double bin_size_;
+    double model_cost_;
+    double decode_cost_;
+    size_t max_num_of_cells_;
+    SparseList<LaplaceStats> sparse_list_;
+    LaplaceStats fallback_;
+    // The statistics of each cell in the order of insertion, and of the fallback cell,
+    // only used in learning
+    LaplaceStatsList learning_stats_;
+    LaplaceStatsList fallback_learning_stats_;
+    // The number of tuples learned without a cell, since the table is full
+    int num_of_fallback_tuples_;
+    // The rows of the cells of sparse_list_ followed by the row of the fallback cell
+    LaplaceBranchTable branch_table_;
+
+    size_t GetSparseListPos(const Tuple& tuple) const;
+    // Return the index of a cell of sparse_list_ in learning_stats_, which is added for
+    // new cells
+    size_t GetLearningStatsIndex(const LaplaceStats* stat);
+    // Keep the max_num_of_cells_ cells with the most tuples in sparse_list_ and
+    // learning_stats_
+    void KeepMostFrequentCells();
+    void BuildBranchTable();
+
+  public:
+    SparseTableLaplace(const Schema& schema, const std::vector<size_t>& predictor_list,
+                       size_t target_var, double err, bool target_int,
+                       size_t max_num_of_cells,
+                       int max_branch_depth = kDefaultLaplaceBranchDepth);
+    SquID* CreateSquID() const { return new LaplaceSquID(bin_size_, target_int_); }
+    void InitSquID(const Tuple& tuple, SquID* squid) const;
+    int GetModelCost() const { return model_cost_; }
+    int64_t GetDecodeCost() const { return decode_cost_; }
+    size_t GetMemoryFootprint() const;
+    void FeedTuple(const Tuple& tuple);
+    void EndOfData();
+    void Merge(const SquIDModel& model);
+
+    int GetModelDescriptionLength() const;
+    void WriteModel(ByteWriter* byte_writer, size_t block_index) const;
+    static SquIDModel* ReadModel(ByteReader* byte_reader,
+                            const Schema& schema, size_t index, bool target_int,
+                            int max_branch_depth = kDefaultLaplaceBranchDepth);
+};
+
+/*
+ * The sparse creators only accept the predictors refused by the corresponding Table
+ * creators for their table sizes, they should be registered after the Table creators for
+ * the same attribute type. The cells of the models are chosen by frequency among the
+ * first kSparseLearningFactor * MAX_NUM_OF_CELLS combinations of predictor values seen,
+ * see SparseTableCategorical.
+ */
+class SparseTableLaplaceRealCreator : public ModelCreator {
+  private:
+    const size_t MIN_TABLE_SIZE = 1000;
+    // The positions of the cells are written in 32 bits
+    const unsigned long long MAX_TABLE_SIZE = 1ull << 32;
+    const size_t MAX_NUM_OF_CELLS = 10000;
+    int max_branch_depth_;
+  public:
+    explicit SparseTableLaplaceRealCreator(
+        int max_branch_depth = kDefaultLaplaceBranchDepth) :
+        max_branch_depth_(max_branch_depth) {}
+    SquIDModel* ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index);
+    SquIDModel* CreateModel(const Schema& schema, const std::vector<size_t>& predictor_list,
+                       size_t target_var, double err);
+};
+
+class SparseTableLaplaceIntCreator : public ModelCreator {
+  private:
+    const size_t MIN_TABLE_SIZE = 1000;
+    const unsigned long long MAX_TABLE_SIZE = 1ull << 32;
+    const size_t MAX_NUM_OF_CELLS = 10000;
+    int max_branch_depth_;
   public:
+    explicit SparseTableLaplaceIntCreator(
+        int max_branch_depth = kDefaultLaplaceBranchDepth) :
+        max_branch_depth_(max_branch_depth) {}
     SquIDModel* ReadModel(ByteReader* byte_reader, const Schema& schema, size_t index);
     SquIDModel* CreateModel(const Schema& schema, const std::vector<size_t>& predictor_list,
                        size_t target_var, double err);
@@ -28,6 +28,15 @@ class MockInterpreter : public AttrInterpreter {
     }
 };
 
+class LargeMockInterpreter : public AttrInterpreter {
+  public:
+    bool EnumInterpretable() const { return true; }
+    int EnumCap() const { return 60000; }
+    int EnumInterpret(const AttrValue* attr) const {
+        return static_cast<const MockAttr*>(attr)->Val();
+    }
+};
+
 Schema schema;
 MockAttr attr;
 IntegerAttrValue num_attr;
@@ -48,6 +57,7 @@ void PrepareData() {
     schema = Schema(schema_);
     pred.push_back(0);
     RegisterAttrInterpreter(0, new MockInterpreter());
+    RegisterAttrInterpreter(2, new LargeMockInterpreter());
 }
 
 void TestSquID() {
@@ -64,8 +74,9 @@ void TestSquID() {
     int branch_prob[9] = {19875, 24109, 0, 65536 - 24109, 24109, 0, 0, 65536 - 24109, 0};
     int boundary[9] = {0, -1, 0, 2, -2, 0, 0, 3, 0};  
     int result[9] = {0, 0, 0, 0, 0, -1, 1, 0, 0};
+    SquIDContext context(*model);
     for (int i = 0; i < 9; ++i) {
-        SquID* tree = model->GetSquID(GetTuple(test_a[i], 0));
+        SquID* tree = model->GetSquID(GetTuple(test_a[i], 0), &context);
         int branch = test_branch[i];
         std::vector<int> branches;
         while (branch > 0) {
@@ -97,6 +108,41 @@ void TestSquID() {
     }
 }
 
+/*
+ * The branches looked up in the LaplaceBranchTable must be the same as those computed
+ * beyond its depth, which is 0 for the second model
+ */
+void TestBranchTable() {
+    TableLaplace model(schema, pred, 1, 0, true), shallow(schema, pred, 1, 0, true, 0);
+    for (int i = 0; i < 300; ++i) {
+        model.FeedTuple(GetTuple(i % 3, (i * 37) % 1000 * (i % 3 + 1) - 500));
+        shallow.FeedTuple(GetTuple(i % 3, (i * 37) % 1000 * (i % 3 + 1) - 500));
+    }
+    model.EndOfData();
+    shallow.EndOfData();
+    SquIDContext context(model), shallow_context(shallow);
+    for (int a = 0; a < 3; ++a)
+    for (int value = -3000; value <= 3000; value += 7) {
+        SquID* tree = model.GetSquID(GetTuple(a, 0), &context);
+        SquID* shallow_tree = shallow.GetSquID(GetTuple(a, 0), &shallow_context);
+        IntegerAttrValue attr(value);
+        while (tree->HasNextBranch()) {
+            tree->GenerateNextBranch();
+            shallow_tree->GenerateNextBranch();
+            int branch = tree->GetNextBranch(&attr);
+            if (tree->GetProbSegs() != shallow_tree->GetProbSegs() ||
+                shallow_tree->GetNextBranch(&attr) != branch)
+                std::cerr << "Branch Table Unit Test Failed!\n";
+            tree->ChooseNextBranch(branch);
+            shallow_tree->ChooseNextBranch(branch);
+        }
+        const AttrValue* result = tree->GetResultAttr();
+        if (shallow_tree->HasNextBranch() ||
+            static_cast<const IntegerAttrValue*>(result)->Value() != value)
+            std::cerr << "Branch Table Unit Test Failed!\n";
+    }
+}
+
 void TestModelCost() {
     std::unique_ptr<SquIDModel> model(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
     for (int i = -1; i <= 1; ++ i)
@@ -107,6 +153,67 @@ void TestModelCost() {
         std::cerr << "Model Cost Unit Test Failed!\n";
     if (model->GetModelCost() != 280)
         std::cerr << "Model Cost Unit Test Failed!\n";
+    // Each value takes 1 + e^(-1/100) * (1 / (1 - 1 / e) + log2(50)) branches on average,
+    // and the predictor costs 0.25 branch
+    if (model->GetDecodeCost() != 33)
+        std::cerr << "Decode Cost Unit Test Failed!\n";
+    // Constant values take no branch
+    std::unique_ptr<SquIDModel> constant(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
+    for (int i = 0; i < 8; ++ i)
+        constant->FeedTuple(GetTuple(i % 3, 5));
+    constant->EndOfData();
+    if (constant->GetDecodeCost() != 2)
+        std::cerr << "Decode Cost Unit Test Failed!\n";
+}
+
+void TestMerge() {
+    // The first part has decided its median, while the second part is still buffering
+    // values, or both parts have decided the same median
+    int part_size[2][2] = {{25, 3}, {30, 30}};
+    for (int test = 0; test < 2; ++test) {
+        std::unique_ptr<SquIDModel> model(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
+        std::unique_ptr<SquIDModel> merged(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
+        std::unique_ptr<SquIDModel> part(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
+        for (int i = 0; i < part_size[test][0] + part_size[test][1]; ++i) {
+            int value = (i % part_size[test][0]) % 7 * 10 - 30;
+            model->FeedTuple(GetTuple(0, value));
+            (i < part_size[test][0] ? merged : part)->FeedTuple(GetTuple(0, value));
+        }
+        merged->Merge(*part);
+        model->EndOfData();
+        merged->EndOfData();
+        if (model->GetModelCost() != merged->GetModelCost())
+            std::cerr << "Model Merge Unit Test Failed!\n";
+    }
+}
+
+void TestShardMerge() {
+    // Both shards have decided their medians, the merged cost should neither depend on the
+    // order of merging nor deviate much from learning the whole stream
+    std::unique_ptr<SquIDModel> model(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
+    std::unique_ptr<SquIDModel> shard[2], merged[2];
+    for (int i = 0; i < 2; ++i) {
+        shard[i].reset(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
+        merged[i].reset(GetAttrModel(1)[0]->CreateModel(schema, pred, 1, 0.1));
+    }
+    unsigned int seed = 1;
+    for (int i = 0; i < 2000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        double uniform = ((seed >> 8) % 9999 + 1) / 10000.0;
+        int value = (uniform < 0.5 ? 100 * log(2 * uniform) : -100 * log(2 - 2 * uniform));
+        model->FeedTuple(GetTuple(0, value));
+        shard[i < 1000 ? 0 : 1]->FeedTuple(GetTuple(0, value));
+    }
+    for (int i = 0; i < 2; ++i) {
+        merged[i]->Merge(*shard[i]);
+        merged[i]->Merge(*shard[1 - i]);
+        merged[i]->EndOfData();
+    }
+    model->EndOfData();
+    if (merged[0]->GetModelCost() != merged[1]->GetModelCost())
+        std::cerr << "Model Shard Merge Unit Test Failed!\n";
+    if (fabs(merged[0]->GetModelCost() - model->GetModelCost()) > model->GetModelCost() / 100)
+        std::cerr << "Model Shard Merge Unit Test Failed!\n";
 }
 
 void TestModelDescription() {
@@ -134,9 +241,10 @@ void TestModelDescription() {
             new_model->GetPredictorList()[0] != 0)
             std::cerr << "Model Description Unit Test Failed!\n";
         int sdev[3] = {1, 0, 100};
+        SquIDContext context(*new_model);
         for (int i = 0; i < 3; ++i) {
             int dev = sdev[i];
-            SquID* tree = new_model->GetSquID(GetTuple(i, 0));
+            SquID* tree = new_model->GetSquID(GetTuple(i, 0), &context);
             if (dev == 0) {
                 if (tree->HasNextBranch())
                     std::cerr << "Model Description Unit Test Failed!\n";
@@ -152,11 +260,69 @@ void TestModelDescription() {
     }
 }
 
+// Constant cells take no branch, while the fallback cell of all the values does
+void CheckSparseTable(const SquIDModel& model) {
+    SquIDContext context(model);
+    SquID* tree = model.GetSquID(GetTuple(50000, 0), &context);
+    if (tree->HasNextBranch() ||
+        static_cast<const IntegerAttrValue*>(tree->GetResultAttr())->Value() != 5)
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+    tree = model.GetSquID(GetTuple(7, 0), &context);
+    if (tree->HasNextBranch() ||
+        static_cast<const IntegerAttrValue*>(tree->GetResultAttr())->Value() != -5)
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+    tree = model.GetSquID(GetTuple(8, 0), &context);
+    if (!tree->HasNextBranch())
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+}
+
+void TestSparseTable() {
+    std::vector<int> attr_type(2, 1);
+    attr_type[0] = 2;
+    Schema sparse_schema(attr_type);
+    TableLaplaceIntCreator dense_creator;
+    SparseTableLaplaceIntCreator sparse_creator;
+    // A single predictor of cap 60000 is too large for the dense table
+    std::unique_ptr<SquIDModel> dense(dense_creator.CreateModel(sparse_schema, pred, 1, 0));
+    std::unique_ptr<SquIDModel> small(sparse_creator.CreateModel(schema, pred, 1, 0));
+    if (dense != nullptr || small != nullptr)
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+    std::unique_ptr<SquIDModel> model(sparse_creator.CreateModel(sparse_schema, pred, 1, 0));
+    std::unique_ptr<SquIDModel> part(sparse_creator.CreateModel(sparse_schema, pred, 1, 0));
+    for (int i = 0; i < 40; ++i) {
+        const Tuple& tuple = (i % 4 == 0 ? GetTuple(7, -5) : GetTuple(50000, 5));
+        (i < 30 ? model : part)->FeedTuple(tuple);
+    }
+    model->Merge(*part);
+    model->EndOfData();
+    // Two cells and the fallback cell
+    if (model->GetModelDescriptionLength() != 344)
+        std::cerr << "Sparse Table Unit Test Failed!\n";
+    CheckSparseTable(*model);
+    {
+        std::vector<size_t> block;
+        block.push_back(model->GetModelDescriptionLength());
+        ByteWriter writer(&block, "byte_writer_test.txt");
+        model->WriteModel(&writer, 0);
+    }
+    {
+        ByteReader reader("byte_writer_test.txt");
+        std::unique_ptr<SquIDModel> new_model(sparse_creator.ReadModel(&reader, sparse_schema, 1));
+        if (new_model->GetPredictorList() != pred)
+            std::cerr << "Sparse Table Unit Test Failed!\n";
+        CheckSparseTable(*new_model);
+    }
+}
+
 void Test() {
     PrepareData();
     TestSquID();
+    TestBranchTable();
     TestModelCost();
     TestModelDescription();
+    TestMerge();
+    TestShardMerge();
+    TestSparseTable();
 }
 
 }  // namespace db_compress
@@ -0,0 +1,75 @@
+#include "range_coder.h"
+
+#include "base.h"
+#include "utility.h"
+
+#include <vector>
+
+namespace db_compress {
+
+/*
+ * The carry bit above the window has to be added to the bytes already emitted. Since
+ * the whole interval lies within [0, 1), the carry never propagates beyond the first byte.
+ */
+void RangeEncoder::PropagateCarry() {
+    low_ -= kWindowTop;
+    for (size_t i = bytes_.size(); i > 0; --i)
+        if (++ bytes_[i - 1] != 0) break;
+}
+
+void RangeEncoder::Renormalize() {
+    if (low_ >= kWindowTop)
+        PropagateCarry();
+    bytes_.push_back((unsigned char)(low_ >> (kWindowBits - 8)));
+    low_ = (low_ << 8) & (kWindowTop - 1);
+    range_ <<= 8;
+}
+
+/*
+ * We search for the shortest bit string (after the emitted bytes) whose unit interval
+ * [value, value + step) lies within [low_, low_ + range_). Since range_ is at least
+ * kRenormBound, at most kWindowBits - 8 + 1 bits are needed.
+ */
+void RangeEncoder::Finish(BitString* bit_string) {
+    int len = 0;
+    unsigned long long step = kWindowTop, value;
+    while (1) {
+        value = (low_ + step - 1) & ~(step - 1);
+        if (value + step <= low_ + range_) break;
+        step >>= 1;
+        ++ len;
+    }
+    if (value >= kWindowTop) {
+        low_ = value;
+        PropagateCarry();
+        value = low_;
+    }
+    for (size_t i = 0; i < bytes_.size(); ++i)
+        StrCat(bit_string, bytes_[i]);
+    // StrCat can only take less than 32 bits at once
+    while (len > 0) {
+        int cat_len = (len > 24 ? 24 : len);
+        len -= cat_len;
+        StrCat(bit_string, (unsigned)(value >> (kWindowBits - cat_len)), cat_len);
+        value = (value << cat_len) & (kWindowTop - 1);
+    }
+}
+
+void InverseCDFTable::Build(const std::vector<Prob>& prob_segs) {
+    boundary.resize(prob_segs.size() + 2);
+    boundary[0] = 0;
+    for (size_t i = 0; i < prob_segs.size(); ++i)
+        boundary[i + 1] = GetProbCode(prob_segs[i]);
+    boundary[prob_segs.size() + 1] = kProbOne;
+
+    lookup.resize(1 << kLookupBits);
+    size_t branch = 0;
+    for (size_t i = 0; i < lookup.size(); ++i) {
+        unsigned pos = i << (kProbBits - kLookupBits);
+        while (boundary[branch + 1] <= pos)
+            ++ branch;
+        lookup[i] = branch;
+    }
+}
+
+}  // namespace db_compress
@@ -0,0 +1,227 @@
+/*
+ * Fixed-precision range coder, which converts the probability intervals produced by
+ * SquIDs into bit strings (encoding) and determines branches from bit strings (decoding).
+ */
+
+#ifndef RANGE_CODER_H
+#define RANGE_CODER_H
+
+#include "base.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace db_compress {
+
+/*
+ * Probability boundaries are quantized to kProbBits bits before coding, which is the
+ * finest base used by any of the SquIDs. The coding window is kWindowBits wide and kept
+ * in 64-bit registers, the bits above the window hold the pending carry. Whenever the
+ * range drops below kRenormBound, one byte is shifted out of the window.
+ */
+const int kProbBits = 16;
+const int kWindowBits = 48;
+const unsigned long long kProbOne = 1ULL << kProbBits;
+const unsigned long long kWindowTop = 1ULL << kWindowBits;
+const unsigned long long kRenormBound = 1ULL << (kWindowBits - 8);
+
+// Cast the probability to an integer numerator with base kProbBits
+inline unsigned GetProbCode(const Prob& prob) { return CastInt(prob, kProbBits); }
+
+/*
+ * RangeEncoder narrows the interval [low, low + range) one ProbInterval at a time and
+ * emits bytes as soon as they are determined. The Finish function appends the shortest
+ * bit string whose unit interval lies within the final interval, so that the result is
+ * a prefix code and can be concatenated with other bit strings.
+ */
+class RangeEncoder {
+  private:
+    unsigned long long low_, range_;
+    std::vector<unsigned char> bytes_;
+
+    void PropagateCarry();
+    void Renormalize();
+  public:
+    RangeEncoder() { Init(); }
+    void Init();
+    // Narrow the interval to [l, r), both are in the unit of 1/2^kProbBits. An empty
+    // interval is an error of the SquID, it is widened to one unit so that encoding
+    // still terminates, but the result can not be decoded.
+    void Encode(unsigned l, unsigned r);
+    void Encode(const ProbInterval& PI) { Encode(GetProbCode(PI.l), GetProbCode(PI.r)); }
+    // Append the encoded bits to the end of bit_string
+    void Finish(BitString* bit_string);
+};
+
+inline void RangeEncoder::Init() {
+    low_ = 0;
+    range_ = kWindowTop;
+    bytes_.clear();
+}
+
+inline void RangeEncoder::Encode(unsigned l, unsigned r) {
+    if (r <= l) {
+        l = std::min(l, (unsigned)kProbOne - 1);
+        r = l + 1;
+    }
+    unsigned long long step = range_ >> kProbBits;
+    low_ += step * l;
+    range_ = step * (r - l);
+    while (range_ < kRenormBound)
+        Renormalize();
+}
+
+/*
+ * InverseCDFTable maps a position within the probability space to the branch it belongs
+ * to, using one lookup on the top kLookupBits bits of the position followed by a short
+ * scan when the probability segments are finer than the lookup table. It is built once
+ * for every distinct probability segment vector and replaces the binary search over the
+ * probability segments during decoding.
+ */
+const int kLookupBits = 8;
+
+struct InverseCDFTable {
+    // boundary[i] is the left boundary of branch i in the unit of 1/2^kProbBits, the
+    // last entry is always 2^kProbBits
+    std::vector<unsigned> boundary;
+    // lookup[i] is the first branch whose right boundary exceeds i << (kProbBits - kLookupBits)
+    std::vector<unsigned short> lookup;
+
+    void Build(const std::vector<Prob>& prob_segs);
+    bool IsBuilt() const { return lookup.size() > 0; }
+};
+
+// Return the index of the highest set bit, val must be positive
+inline int GetHighestBit(unsigned long long val) {
+    int ret = 0;
+    for (int shift = 32; shift > 0; shift >>= 1)
+    if ((val >> shift) != 0) {
+        val >>= shift;
+        ret += shift;
+    }
+    return ret;
+}
+
+/*
+ * RangeDecoder mirrors the low_ and range_ registers of RangeEncoder. Instead of the
+ * exact code value, it keeps track of the interval [code_, code_ + 2^free_bits_)
+ * (relative to low_) which contains all code values that start with the bits read so
+ * far. A branch is determined once this interval lies within the sub-interval of a
+ * single branch. Bits can be fed one at a time, in which case the decoder never reads
+ * beyond the end of a bit string, or in bulk, in which case GetSurplusBits tells how
+ * many of the bits fed were not actually part of the bit string.
+ */
+class RangeDecoder {
+  private:
+    unsigned long long low_, code_, range_;
+    int free_bits_;
+  public:
+    RangeDecoder() { Init(); }
+    void Init();
+    inline void FeedBit(bool bit);
+    // Feed len bits at once, len must not exceed GetFreeBits()
+    inline void FeedBits(unsigned long long bits, int len);
+    // The maximum number of bits that can be fed before the next branch is determined
+    int GetFreeBits() const { return free_bits_; }
+    // The number of trailing bits fed which are not needed to determine the branches
+    // decided so far
+    inline int GetSurplusBits() const;
+    // Return true and set branch if the bits read so far are enough to determine the
+    // branch given the probability segments, the state is then advanced to that branch.
+    inline bool Decode(const ProbSegs& prob_segs, int* branch);
+    // Same as above, but uses the inverse CDF table to locate the branch
+    inline bool Decode(const InverseCDFTable& inverse_cdf, int* branch);
+  private:
+    // Advance the state to the sub-interval [left, right) relative to low_
+    inline void Narrow(unsigned long long left, unsigned long long right);
+};
+
+inline void RangeDecoder::Init() {
+    low_ = 0;
+    code_ = 0;
+    range_ = kWindowTop;
+    free_bits_ = kWindowBits;
+}
+
+inline void RangeDecoder::FeedBit(bool bit) {
+    -- free_bits_;
+    if (bit)
+        code_ += (1ULL << free_bits_);
+}
+
+inline void RangeDecoder::FeedBits(unsigned long long bits, int len) {
+    free_bits_ -= len;
+    code_ += (bits << free_bits_);
+}
+
+/*
+ * We look for the largest aligned block containing the code value that still lies within
+ * [low_, low_ + range_). The block of size 2^k containing code value c starts no earlier
+ * than low_ iff c and low_ - 1 differ at bit k or above, and ends no later than
+ * low_ + range_ iff c and low_ + range_ differ at bit k or above.
+ */
+inline int RangeDecoder::GetSurplusBits() const {
+    unsigned long long code = low_ + code_;
+    int max_bits = GetHighestBit(code ^ (low_ + range_));
+    if (low_ > 0) {
+        int bits = GetHighestBit(code ^ (low_ - 1));
+        if (bits < max_bits)
+            max_bits = bits;
+    }
+    return max_bits - free_bits_;
+}
+
+inline bool RangeDecoder::Decode(const ProbSegs& prob_segs, int* branch) {
+    unsigned long long step = range_ >> kProbBits;
+    // Find the last branch whose left boundary is no larger than code_
+    size_t l = 0, r = prob_segs.size();
+    while (l < r) {
+        size_t mid = (l + r + 1) / 2;
+        if (step * GetProbCode(prob_segs[mid - 1]) <= code_)
+            l = mid;
+        else
+            r = mid - 1;
+    }
+    unsigned long long left = (l == 0 ? 0 : step * GetProbCode(prob_segs[l - 1]));
+    unsigned long long right = (l == prob_segs.size() ? step * kProbOne
+                                                       : step * GetProbCode(prob_segs[l]));
+    if (code_ + (1ULL << free_bits_) > right)
+        return false;
+    Narrow(left, right);
+    *branch = l;
+    return true;
+}
+
+inline bool RangeDecoder::Decode(const InverseCDFTable& inverse_cdf, int* branch) {
+    unsigned long long step = range_ >> kProbBits;
+    unsigned long long pos = code_ / step;
+    if (pos >= kProbOne)
+        return false;
+    size_t l = inverse_cdf.lookup[pos >> (kProbBits - kLookupBits)];
+    while (inverse_cdf.boundary[l + 1] <= pos)
+        ++ l;
+    unsigned long long left = step * inverse_cdf.boundary[l];
+    unsigned long long right = step * inverse_cdf.boundary[l + 1];
+    if (code_ + (1ULL << free_bits_) > right)
+        return false;
+    Narrow(left, right);
+    *branch = l;
+    return true;
+}
+
+inline void RangeDecoder::Narrow(unsigned long long left, unsigned long long right) {
+    low_ = (low_ + left) & (kWindowTop - 1);
+    code_ -= left;
+    range_ = right - left;
+    while (range_ < kRenormBound) {
+        low_ = (low_ << 8) & (kWindowTop - 1);
+        code_ <<= 8;
+        range_ <<= 8;
+        free_bits_ += 8;
+    }
+}
+
+}  // namespace db_compress
+
+#endif
@@ -0,0 +1,190 @@
+#include "base.h"
+#include "range_coder.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <iostream>
+
+namespace db_compress {
+
+inline bool GetBit(const BitString& str, size_t pos) {
+    return (str.bits[pos / 32] >> (31 - (pos & 31))) & 1;
+}
+
+void TestRangeEncoder() {
+    BitString str;
+    // Test #1: [3/8, 5/8) * [1/4, 3/4) = [7/16, 9/16)
+    RangeEncoder encoder;
+    encoder.Encode(ProbInterval(GetProb(3, 3), GetProb(5, 3)));
+    encoder.Encode(ProbInterval(GetProb(1, 2), GetProb(3, 2)));
+    str.Clear();
+    encoder.Finish(&str);
+    if (str.length != 4 || str.bits[0] != 0x70000000)
+        std::cerr << "Range Encoder Unit Test #1 Failed!\n";
+    // Test #2: [7/128, 9/128), the leftmost of the shortest bit strings is chosen
+    encoder.Init();
+    encoder.Encode(ProbInterval(GetProb(7, 7), GetProb(9, 7)));
+    str.Clear();
+    encoder.Finish(&str);
+    if (str.length != 7 || str.bits[0] != 0x0e000000)
+        std::cerr << "Range Encoder Unit Test #2 Failed!\n";
+    // Test #3: Emits bytes, [0x7001/2^16, 0x7002/2^16) * [0, 1)
+    encoder.Init();
+    encoder.Encode(0x7001, 0x7002);
+    encoder.Encode(0, 1 << 16);
+    str.Clear();
+    encoder.Finish(&str);
+    if (str.length != 16 || str.bits[0] != 0x70010000)
+        std::cerr << "Range Encoder Unit Test #3 Failed!\n";
+    // Test #4: Carry, [0x7fff/2^16, 0x8001/2^16) * [1/2, 1) = [1/2, 0x8001/2^16)
+    encoder.Init();
+    encoder.Encode(0x7fff, 0x8001);
+    encoder.Encode(0x8000, 0x10000);
+    str.Clear();
+    encoder.Finish(&str);
+    if (str.length != 16 || str.bits[0] != 0x80000000)
+        std::cerr << "Range Encoder Unit Test #4 Failed!\n";
+    encoder.Init();
+    encoder.Encode(0x7fff, 0x8001);
+    encoder.Encode(0x8000, 0x10000);
+    encoder.Encode(0, 0x100);
+    str.Clear();
+    encoder.Finish(&str);
+    if (str.length != 24 || str.bits[0] != 0x80000000)
+        std::cerr << "Range Encoder Unit Test #4 Failed!\n";
+    // Test #5: Empty interval list leads to empty bit string
+    encoder.Init();
+    str.Clear();
+    encoder.Finish(&str);
+    if (str.length != 0)
+        std::cerr << "Range Encoder Unit Test #5 Failed!\n";
+    // Test #6: Intervals narrower than 2^-16 are widened to one unit instead of looping,
+    // [1/2, 1/2 + 1/2^20) is quantized to [0x8000/2^16, 0x8000/2^16)
+    encoder.Init();
+    encoder.Encode(ProbInterval(GetProb(1, 1), GetProb((1 << 19) + 1, 20)));
+    encoder.Encode(0x10000, 0x10000);
+    str.Clear();
+    encoder.Finish(&str);
+    if (str.length != 32 || str.bits[0] != 0x8000ffff)
+        std::cerr << "Range Encoder Unit Test #6 Failed!\n";
+}
+
+void TestInverseCDFTable() {
+    std::vector<Prob> prob_segs;
+    prob_segs.push_back(GetProb(1, 16));
+    prob_segs.push_back(GetProb(1, 16));
+    prob_segs.push_back(GetProb(3, 2));
+    InverseCDFTable table;
+    if (table.IsBuilt())
+        std::cerr << "Inverse CDF Table Unit Test Failed!\n";
+    table.Build(prob_segs);
+    if (!table.IsBuilt() || table.boundary.size() != 5 || table.boundary[4] != 65536)
+        std::cerr << "Inverse CDF Table Unit Test Failed!\n";
+    // Branch 1 is empty, so lookup entries other than the first start from branch 2
+    if (table.lookup[0] != 0 || table.lookup[1] != 2 || table.lookup[191] != 2 ||
+        table.lookup[192] != 3 || table.lookup[255] != 3)
+        std::cerr << "Inverse CDF Table Unit Test Failed!\n";
+}
+
+void TestRangeDecoder() {
+    srand(0);
+    for (int round = 0; round < 200; ++round) {
+        // Generate random probability segments and random branches
+        std::vector<std::vector<Prob> > prob_segs;
+        std::vector<ProbInterval> prob_intervals;
+        std::vector<int> branches;
+        int steps = rand() % 40 + 1;
+        for (int i = 0; i < steps; ++i) {
+            std::vector<int> bounds;
+            if (rand() % 4 == 0) {
+                // Extremely skewed branches are more likely to trigger carries
+                bounds.push_back(rand() % 2 == 0 ? 1 : 65535);
+            } else {
+                int num_of_branches = rand() % 5 + 1;
+                for (int j = 1; j < num_of_branches; ++j)
+                    bounds.push_back(rand() % 65535 + 1);
+                std::sort(bounds.begin(), bounds.end());
+            }
+            std::vector<Prob> segs;
+            for (size_t j = 0; j < bounds.size(); ++j)
+                segs.push_back(GetProb(bounds[j], 16));
+            prob_segs.push_back(segs);
+            // Randomly choose a branch with non-zero probability
+            while (1) {
+                int branch = rand() % (segs.size() + 1);
+                Prob l = (branch == 0 ? GetZeroProb() : segs[branch - 1]);
+                Prob r = (branch == (int)segs.size() ? GetOneProb() : segs[branch]);
+                if (l < r) {
+                    branches.push_back(branch);
+                    prob_intervals.push_back(ProbInterval(l, r));
+                    break;
+                }
+            }
+        }
+
+        RangeEncoder encoder;
+        for (int i = 0; i < steps; ++i)
+            encoder.Encode(prob_intervals[i]);
+        BitString str;
+        str.Clear();
+        encoder.Finish(&str);
+
+        RangeDecoder decoder;
+        size_t pos = 0;
+        if (round % 2 == 0) {
+            // Feed bits in bulk and count the surplus bits afterwards
+            size_t fed = 0;
+            for (int i = 0; i < steps; ++i) {
+                int branch = -1;
+                while (!decoder.Decode(ProbSegs(prob_segs[i]), &branch)) {
+                    int len = decoder.GetFreeBits();
+                    unsigned long long bits = 0;
+                    for (int j = 0; j < len; ++j, ++fed)
+                        bits = (bits << 1) | (fed < str.length ? GetBit(str, fed) : 0);
+                    decoder.FeedBits(bits, len);
+                }
+                if (branch != branches[i]) {
+                    std::cerr << "Range Decoder Unit Test Failed!\n";
+                    break;
+                }
+            }
+            if (fed - decoder.GetSurplusBits() != str.length)
+                std::cerr << "Range Decoder Unit Test Failed!\n";
+            continue;
+        }
+        // Every other round decodes using the inverse CDF tables instead
+        std::vector<InverseCDFTable> tables(steps);
+        if (round % 4 == 3)
+            for (int i = 0; i < steps; ++i)
+                tables[i].Build(prob_segs[i]);
+        for (int i = 0; i < steps; ++i) {
+            int branch = -1;
+            while (tables[i].IsBuilt() ? !decoder.Decode(tables[i], &branch)
+                                       : !decoder.Decode(ProbSegs(prob_segs[i]), &branch)) {
+                if (pos >= str.length) break;
+                decoder.FeedBit(GetBit(str, pos ++));
+            }
+            if (branch != branches[i]) {
+                std::cerr << "Range Decoder Unit Test Failed!\n";
+                break;
+            }
+        }
+        // The decoder should consume exactly the bits produced by the encoder
+        if (pos != str.length)
+            std::cerr << "Range Decoder Unit Test Failed!\n";
+    }
+}
+
+void Test() {
+    TestRangeEncoder();
+    TestInverseCDFTable();
+    TestRangeDecoder();
+}
+
+}  // namespace db_compress
+
+int main() {
+    db_compress::Test();
+}
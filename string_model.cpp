@@ -12,19 +12,26 @@
 namespace db_compress {
 
 inline void StringSquID::Init(const std::vector<Prob>* char_prob, 
-                              const std::vector<Prob>* len_prob) {
+                              const std::vector<Prob>* len_prob,
+                              const InverseCDFTable* char_inverse_cdf,
+                              const InverseCDFTable* len_inverse_cdf) {
     char_prob_ = char_prob;
     len_prob_ = len_prob;
+    char_inverse_cdf_ = (char_inverse_cdf->IsBuilt() ? char_inverse_cdf : NULL);
+    len_inverse_cdf_ = (len_inverse_cdf->IsBuilt() ? len_inverse_cdf : NULL);
     is_end_ = false;
     len_ = -1,
     attr_.Set("");
 }
 
 void StringSquID::GenerateNextBranch() {
-    if (len_ == -1)
-        prob_segs_ = *len_prob_;
-    else if (attr_.Value().length() == 0)
-        prob_segs_ = *char_prob_;
+    if (len_ == -1) {
+        prob_segs_ = ProbSegs(*len_prob_);
+        inverse_cdf_ = len_inverse_cdf_;
+    } else if (attr_.Value().length() == 0) {
+        prob_segs_ = ProbSegs(*char_prob_);
+        inverse_cdf_ = char_inverse_cdf_;
+    }
 }
 
 int StringSquID::GetNextBranch(const AttrValue* attr) const {
@@ -52,9 +59,9 @@ StringModel::StringModel(size_t target_var) :
     char_count_(256),
     length_count_(64) {}
 
-SquID* StringModel::GetSquID(const Tuple& tuple) {
-    squid_.Init(&char_prob_, &length_prob_);
-    return &squid_;
+void StringModel::InitSquID(const Tuple& tuple, SquID* squid) const {
+    static_cast<StringSquID*>(squid)->Init(&char_prob_, &length_prob_, 
+                                           &char_inverse_cdf_, &length_inverse_cdf_);
 }
 
 void StringModel::FeedTuple(const Tuple& tuple) {
@@ -70,6 +77,14 @@ void StringModel::FeedTuple(const Tuple& tuple) {
     }
 }
 
+void StringModel::Merge(const SquIDModel& model) {
+    const StringModel& other = static_cast<const StringModel&>(model);
+    for (size_t i = 0; i < char_count_.size(); ++i )
+        char_count_[i] += other.char_count_[i];
+    for (size_t i = 0; i < length_count_.size(); ++i )
+        length_count_[i] += other.length_count_[i];
+}
+
 void StringModel::EndOfData() {
     // Calculate the probability vector of characters
     Quantization(&char_prob_, char_count_, 16);
@@ -110,6 +125,8 @@ SquIDModel* StringModel::ReadModel(ByteReader* byte_reader, size_t index) {
         model->char_prob_[i] = GetProb(byte_reader->Read16Bit(), 16);
     for (int i = 0; i < 63; ++i )
         model->length_prob_[i] = GetProb(byte_reader->ReadByte(), 8);
+    model->char_inverse_cdf_.Build(model->char_prob_);
+    model->length_inverse_cdf_.Build(model->length_prob_);
     return model;
 }
 
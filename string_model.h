@@ -23,13 +23,15 @@ class StringAttrValue: public AttrValue {
 class StringSquID : public SquID {
   private:
     const std::vector<Prob> *char_prob_, *len_prob_;
+    const InverseCDFTable *char_inverse_cdf_, *len_inverse_cdf_;
     bool is_end_;
     int len_;
 
     StringAttrValue attr_;
     
   public:
-    void Init(const std::vector<Prob>* char_prob, const std::vector<Prob>* len_prob);
+    void Init(const std::vector<Prob>* char_prob, const std::vector<Prob>* len_prob,
+              const InverseCDFTable* char_inverse_cdf, const InverseCDFTable* len_inverse_cdf);
     bool HasNextBranch() const { return !is_end_; }
     void GenerateNextBranch();
     int GetNextBranch(const AttrValue* attr) const;
@@ -41,15 +43,17 @@ class StringModel : public SquIDModel {
   private:
     std::vector<Prob> char_prob_, length_prob_;
     std::vector<int> char_count_, length_count_;
-
-    StringSquID squid_;
+    // Only built for decoding
+    InverseCDFTable char_inverse_cdf_, length_inverse_cdf_;
   public:
     StringModel(size_t target_var);
-    SquID* GetSquID(const Tuple& tuple);
+    SquID* CreateSquID() const { return new StringSquID(); }
+    void InitSquID(const Tuple& tuple, SquID* squid) const;
     int GetModelCost() const;
 
     void FeedTuple(const Tuple& tuple);
     void EndOfData();
+    void Merge(const SquIDModel& model);
 
     int GetModelDescriptionLength() const;
     void WriteModel(ByteWriter* byte_writer, size_t block_index) const;
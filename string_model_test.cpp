@@ -37,8 +37,9 @@ void TestSquID() {
     model->FeedTuple(GetTuple("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
                               "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"));
     model->EndOfData();
+    SquIDContext context(*model);
     for (int len = 0; len < 100; ++len) {
-        SquID* tree = model->GetSquID(GetTuple(""));
+        SquID* tree = model->GetSquID(GetTuple(""), &context);
         if (!tree->HasNextBranch())
             std::cerr << "SquID Unit Test Failed!\n";
         tree->GenerateNextBranch();
@@ -82,7 +83,8 @@ void TestModelDescription() {
         std::unique_ptr<SquIDModel> new_model(GetAttrModel(0)[0]->ReadModel(&reader, schema, 0));
         if (new_model->GetTargetVar() != 0 || new_model->GetPredictorList().size() != 0)
             std::cerr << "Model Description Unit Test Failed!\n";
-        SquID* tree = new_model->GetSquID(GetTuple(""));
+        SquIDContext context(*new_model);
+        SquID* tree = new_model->GetSquID(GetTuple(""), &context);
         tree->GenerateNextBranch();
         if (tree->GetProbSegs()[2] != GetZeroProb() || tree->GetProbSegs()[3] != GetProb(255, 8))
             std::cerr << "Model Description Unit Test Failed!\n";
@@ -94,11 +96,38 @@ void TestModelDescription() {
     }    
 }
 
+void TestMerge() {
+    std::unique_ptr<SquIDModel> model(GetAttrModel(0)[0]->CreateModel(schema, pred, 0, 0));
+    std::unique_ptr<SquIDModel> part(GetAttrModel(0)[0]->CreateModel(schema, pred, 0, 0));
+    std::unique_ptr<SquIDModel> merged(GetAttrModel(0)[0]->CreateModel(schema, pred, 0, 0));
+    const char* strs[4] = {"abc", "", "hello", "aaaaaaa"};
+    for (int i = 0; i < 4; ++i) {
+        model->FeedTuple(GetTuple(strs[i]));
+        (i < 2 ? merged : part)->FeedTuple(GetTuple(strs[i]));
+    }
+    merged->Merge(*part);
+    model->EndOfData();
+    merged->EndOfData();
+    SquIDContext context(*model), merged_context(*merged);
+    SquID* tree = model->GetSquID(GetTuple(""), &context);
+    SquID* merged_tree = merged->GetSquID(GetTuple(""), &merged_context);
+    // Compare the length distribution and then the character distribution
+    for (int i = 0; i < 2; ++i) {
+        tree->GenerateNextBranch();
+        merged_tree->GenerateNextBranch();
+        if (tree->GetProbSegs() != merged_tree->GetProbSegs())
+            std::cerr << "Model Merge Unit Test Failed!\n";
+        tree->ChooseNextBranch(5);
+        merged_tree->ChooseNextBranch(5);
+    }
+}
+
 void Test() {
     PrepareData();
     TestSquID();
     TestModelCost();
     TestModelDescription();
+    TestMerge();
 }
 
 }  // namespace db_compress
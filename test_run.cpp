@@ -5,7 +5,10 @@
 #include "unit_test.h"
 
 #include <vector>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string>
 
 namespace db_compress {
 
@@ -51,9 +54,124 @@ void TestRun() {
     }
 }
 
+inline int GetValue(int tuple_index, int attr_index) {
+    return (tuple_index * (attr_index + 3) + tuple_index / 7) % (attr_index + 1);
+}
+
+void FormatTuple(const Tuple& tuple, std::string* str) {
+    for (int i = 0; i < 10; i++)
+        str->push_back('0' + static_cast<const MockAttr*>(tuple.attr[i])->Val());
+    str->push_back('\n');
+}
+
+std::string ReadFile(const char* file_name) {
+    std::ifstream fin(file_name, std::ios::binary);
+    std::stringstream stream;
+    stream << fin.rdbuf();
+    return stream.str();
+}
+
+void TestParallelCompression(int num_of_tuples) {
+    std::string expected = ReadFile("compression_test.txt");
+    CompressionConfig parallel_config = config;
+    parallel_config.num_of_threads = 3;
+    std::vector< std::vector<MockAttr> > vec(700, std::vector<MockAttr>(10, MockAttr(0)));
+    std::vector<Tuple> tuples(700, Tuple(10));
+    {
+        Compressor compressor("compression_test.txt", schema, parallel_config);
+        while (compressor.RequireMoreIterations()) {
+            for (int i = 0; i < num_of_tuples; i += 700) {
+                tuples.resize(num_of_tuples - i < 700 ? num_of_tuples - i : 700, Tuple(10));
+                for (size_t j = 0; j < tuples.size(); ++j)
+                for (int k = 0; k < 10; ++k) {
+                    vec[j][k].Set(GetValue(i + j, k));
+                    tuples[j].attr[k] = &vec[j][k];
+                }
+                compressor.ReadTuples(tuples);
+            }
+            compressor.EndOfData();
+        }
+    }
+    // The output does not depend on the number of threads
+    if (ReadFile("compression_test.txt") != expected)
+        std::cerr << "Parallel Compression Test Run Failed!\n";
+}
+
+void TestRandomAccess(const std::string& sequential) {
+    Decompressor decompressor("compression_test.txt", schema);
+    decompressor.Init();
+    decompressor.SetCacheCapacity(2);
+    if (decompressor.GetNumOfTuples() != sequential.length() / 11)
+        std::cerr << "Random Access Test Run Failed!\n";
+    // Seeks jump across segments, so that the cached positions are both reused and evicted
+    size_t seek_pos[] = {1234, 0, 1235, 2600, 3900, 17, 2599, 4999};
+    Tuple tuple_(10);
+    for (int i = 0; i < 8; ++i) {
+        decompressor.SeekTuple(seek_pos[i]);
+        std::string str;
+        for (size_t j = seek_pos[i]; j < seek_pos[i] + 3 && j < 5000; ++j) {
+            if (!decompressor.HasNext())
+                std::cerr << "Random Access Test Run Failed!\n";
+            decompressor.ReadNextTuple(&tuple_);
+            FormatTuple(tuple_, &str);
+        }
+        if (str != sequential.substr(seek_pos[i] * 11, str.length()) || str.length() == 0)
+            std::cerr << "Random Access Test Run Failed!\n";
+    }
+    if (decompressor.HasNext())
+        std::cerr << "Random Access Test Run Failed!\n";
+    decompressor.SeekTuple(5000);
+    if (decompressor.HasNext())
+        std::cerr << "Random Access Test Run Failed!\n";
+}
+
+void TestParallelRun() {
+    const int num_of_tuples = 5000;
+    std::vector<MockAttr> vec(10, MockAttr(0));
+    Tuple tuple(10);
+    for (int i = 0; i < 10; ++i)
+        tuple.attr[i] = &vec[i];
+    {
+        Compressor compressor("compression_test.txt", schema, config);
+        while (compressor.RequireMoreIterations()) {
+            for (int i = 0; i < num_of_tuples; ++i) {
+                for (int j = 0; j < 10; ++j)
+                    vec[j].Set(GetValue(i, j));
+                compressor.ReadTuple(tuple);
+            }
+            compressor.EndOfData();
+        }
+    }
+
+    // Tuples are stored in the order of blocks, use the sequential output as reference
+    std::string sequential;
+    {
+        Decompressor decompressor("compression_test.txt", schema);
+        decompressor.Init();
+        Tuple tuple_(10);
+        while (decompressor.HasNext()) {
+            decompressor.ReadNextTuple(&tuple_);
+            FormatTuple(tuple_, &sequential);
+        }
+    }
+    if (sequential.length() != 11 * num_of_tuples)
+        std::cerr << "Parallel Test Run Failed!\n";
+
+    ParallelDecompressor decompressor("compression_test.txt", schema, 3);
+    if (decompressor.GetNumOfSegments() != 4)
+        std::cerr << "Parallel Test Run Failed!\n";
+    std::stringstream stream;
+    decompressor.Run(FormatTuple, &stream);
+    if (stream.str() != sequential)
+        std::cerr << "Parallel Test Run Failed!\n";
+    TestRandomAccess(sequential);
+    TestParallelCompression(num_of_tuples);
+}
+
 void Test() {
     PrepareData();
     TestRun();
+    TestParallelRun();
 }
 
 }  // namespace db_compress
@@ -17,16 +17,17 @@ class MockSquID : public SquID {
     bool first_step_;
     int branches_;
     int choice_;
+    std::vector<Prob> prob_;
 
     MockAttr attr_;
   public:
-    MockSquID(int branches) : first_step_(true), branches_(branches), attr_(0) {}
-    bool HasNextBranch() const { return first_step_; }
-    void GenerateNextBranch() {
-        prob_segs_.clear();
+    MockSquID(int branches) : first_step_(true), branches_(branches), attr_(0) {
         for (int i = 1; i < branches_; ++i)
-            prob_segs_.push_back(GetProb(65536 * i / branches_, 16));
+            prob_.push_back(GetProb(65536 * i / branches_, 16));
     }
+    void Init() { first_step_ = true; }
+    bool HasNextBranch() const { return first_step_; }
+    void GenerateNextBranch() { prob_segs_ = ProbSegs(prob_); }
     int GetNextBranch(const AttrValue* attr) const {
         return static_cast<const MockAttr*>(attr)->Val();
     }
@@ -43,14 +44,13 @@ class MockSquID : public SquID {
 class MockModel : public SquIDModel {
   private:
     int branch_;
-    std::unique_ptr<SquID> squid_;
   public:
     MockModel(const std::vector<size_t>& pred, size_t target_var, int branch) : 
       SquIDModel(pred, target_var), 
       branch_(branch) {}
-    SquID* GetSquID(const Tuple& tuple) {
-        squid_.reset(new MockSquID(branch_));
-        return squid_.get();
+    SquID* CreateSquID() const { return new MockSquID(branch_); }
+    void InitSquID(const Tuple& tuple, SquID* squid) const {
+        static_cast<MockSquID*>(squid)->Init();
     }
     int GetModelDescriptionLength() const { return 8; }
     void WriteModel(ByteWriter* byte_writer, size_t block_index) const {
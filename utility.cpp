@@ -2,12 +2,45 @@
 
 #include "base.h"
 
+#include <atomic>
 #include <iostream>
 #include <cmath>
+#include <thread>
 #include <vector>
 
 namespace db_compress {
 
+void CountMatrix::Widen(size_t row_size) {
+    std::vector<int> count(num_of_rows_ * row_size);
+    for (size_t i = 0; i < num_of_rows_; ++i)
+        std::copy(count_.begin() + i * row_size_, count_.begin() + (i + 1) * row_size_,
+                  count.begin() + i * row_size);
+    count_.swap(count);
+    row_size_ = row_size;
+}
+
+void CountMatrix::AddRows(size_t num_of_rows) {
+    num_of_rows_ += num_of_rows;
+    count_.resize(num_of_rows_ * row_size_);
+}
+
+void CountMatrix::MergeRow(size_t row, const CountMatrix& other, size_t other_row) {
+    // Find the largest value of the other row first, so that the row is widened once
+    size_t size = other.row_size_;
+    const int* other_count = other.count_.data() + other_row * other.row_size_;
+    while (size > 0 && other_count[size - 1] == 0)
+        -- size;
+    if (size > row_size_)
+        Widen(std::max(size, row_size_ * 2));
+    for (size_t j = 0; j < size; ++j)
+        count_[row * row_size_ + j] += other_count[j];
+}
+
+void CountMatrix::Clear() {
+    std::vector<int>().swap(count_);
+    num_of_rows_ = row_size_ = 0;
+}
+
 /*
  * The quantization follows two steps:
  * 1. Mark all categories consists of less than 1/2^base portion of total count
@@ -51,69 +84,6 @@ void Quantization(std::vector<Prob>* prob, const std::vector<int>& cnt, int base
     }
 }
 
-ProbInterval GetPIProduct(const ProbInterval& left, const ProbInterval& right,
-                             std::vector<unsigned char>* emit_bytes) {
-    Prob range(left.r - left.l);
-    ProbInterval product(left.l + range * right.l, left.l + range * right.r);
-
-    if (emit_bytes != NULL) {
-        while (1) {
-            while (1) {
-                int bracket = CastInt(product.l, 8);
-                if (product.r <= GetProb(bracket + 1, 8)) {
-                    product.l = product.l - GetProb(bracket, 8);
-                    product.r = product.r - GetProb(bracket, 8);
-                    product.l.exp -= 8;
-                    product.r.exp -= 8;
-                    emit_bytes->push_back((unsigned char)bracket);
-                } else break;
-            }
-            product.l.Reduce();
-            product.r.Reduce();
-            if (product.l.exp <= 16 && product.r.exp <= 16) break; 
-            Prob new_left = product.l, new_right;
-            if (product.l > GetProb(CastInt(product.l, 16), 16))
-                new_left = GetProb(CastInt(product.l, 16) + 1, 16);
-            new_right = GetProb(CastInt(product.r, 16), 16);
-
-            if (new_left != new_right) {
-                product.l = new_left;
-                product.r = new_right;
-            } else {
-                if (new_left - product.l < product.r - new_right)
-                    product.l = new_left;
-                else
-                    product.r = new_right;
-            }
-        }
-    }
-    return product;
-}
-
-ProbInterval ReducePIProduct(const std::vector<ProbInterval>& vec,
-                             std::vector<unsigned char>* emit_bytes) {
-    if (vec.size() == 0) return ProbInterval(GetZeroProb(), GetOneProb());
-    
-    ProbInterval ret = vec[0];
-    for (size_t i = 1; i < vec.size(); ++i ) {
-        ret = GetPIProduct(ret, vec[i], emit_bytes);
-    }
-    return ret;
-}
-
-Prob GetPIRatioPoint(const ProbInterval& PI, const Prob& ratio) {
-    return PI.l + (PI.r - PI.l) * ratio;
-}
-
-void ReducePI(UnitProbInterval* PI, const std::vector<unsigned char>& bytes) {
-    for (size_t i = 0; i < bytes.size(); ++i) {
-        long long byte = bytes[i];
-        // PI->l = (PI->l - byte/256) * 256, PI->r = (PI->r - byte/256) * 256
-        PI->exp -= 8;
-        PI->num -= byte << PI->exp;
-    }
-}
-
 void QuantizationToFloat32Bit(double* val) {
     unsigned char bytes[4];
     ConvertSinglePrecision(*val, bytes);
@@ -194,24 +164,24 @@ void StrCat(BitString* str, const BitString& cat) {
     }
 }
 
-void GetBitStringFromProbInterval(BitString *str, const ProbInterval& prob) {
-    str->Clear();
-    UnitProbInterval PI = GetWholeProbInterval();
-    while (PI.Left() < prob.l || PI.Right() > prob.r) {
-        int offset = str->length & 31;
-        if (offset == 0)
-             str->bits.push_back(0);
-        unsigned& last = str->bits[str->length / 32];
-
-        if (PI.Mid() - prob.l > prob.r - PI.Mid()) {
-            PI.GoLeft();
-        } else {
-            last |= (1 << (31 - offset));
-            PI.GoRight();
-        }
-        str->length ++;
+void ParallelFor(size_t n, int num_of_threads, const std::function<void(int, size_t)>& task) {
+    if (num_of_threads <= 1 || n <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            task(0, i);
+        return;
     }
-
+    std::atomic<size_t> next(0);
+    auto worker = [&](int index) {
+        size_t i;
+        while ((i = next.fetch_add(1)) < n)
+            task(index, i);
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_of_threads; ++i)
+        threads.push_back(std::thread(worker, i));
+    worker(0);
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
 }
 
 }  // namespace db_compress
@@ -5,12 +5,53 @@
 
 #include "base.h"
 
+#include <algorithm>
 #include <iostream>
+#include <functional>
 #include <vector>
 #include <cmath>
 
 namespace db_compress {
 
+/*
+ * Return the row-major strides of the dimensions with the given caps
+ */
+inline std::vector<size_t> GetRowMajorStride(const std::vector<size_t>& index_cap) {
+    std::vector<size_t> stride(index_cap.size());
+    size_t size = 1;
+    for (size_t i = index_cap.size(); i > 0; --i) {
+        stride[i - 1] = size;
+        size *= index_cap[i - 1];
+    }
+    return stride;
+}
+
+/*
+ * Return the row-major position of the cell whose index in the i-th dimension is index(i).
+ * The positions of up to three dimensions are computed without loops, and index is usually
+ * a lambda that interprets the predictors in place, so that no index vector is built.
+ */
+template<class IndexFunc>
+inline size_t GetRowMajorPos(const std::vector<size_t>& stride, const IndexFunc& index) {
+    switch (stride.size()) {
+      case 0:
+        return 0;
+      case 1:
+        return index(0);
+      case 2:
+        return index(0) * stride[0] + index(1);
+      case 3:
+        return index(0) * stride[0] + index(1) * stride[1] + index(2);
+      default:
+        {
+            size_t pos = 0;
+            for (size_t i = 0; i < stride.size(); ++i)
+                pos += index(i) * stride[i];
+            return pos;
+        }
+    }
+}
+
 /*
  * Dynamic List behaves like multi-dimensional array, except that the number of dimensions
  * can vary across different instances. The number of dimensions need to be specified in
@@ -21,6 +62,7 @@ class DynamicList {
   private:
     std::vector<T> dynamic_list_;
     std::vector<size_t> index_cap_;
+    std::vector<size_t> stride_;
   public:
     DynamicList(const std::vector<size_t>& index_cap);
     T& operator[](const std::vector<size_t>& index);
@@ -28,11 +70,15 @@ class DynamicList {
     T& operator[](int index) { return dynamic_list_[index]; }
     const T& operator[] (int index) const { return dynamic_list_[index]; }
     size_t size() const { return dynamic_list_.size(); }
+    // See GetRowMajorPos, the position can be used with operator[]
+    template<class IndexFunc>
+    size_t GetPos(const IndexFunc& index) const { return GetRowMajorPos(stride_, index); }
 };
 
 template<class T>
 DynamicList<T>::DynamicList(const std::vector<size_t>& index_cap) :
-    index_cap_(index_cap) {
+    index_cap_(index_cap),
+    stride_(GetRowMajorStride(index_cap)) {
     int size = 1;
     for (size_t i = 0; i < index_cap.size(); ++i)
         size *= index_cap[i];
@@ -45,10 +91,7 @@ T& DynamicList<T>::operator[](const std::vector<size_t>& index) {
     if (index.size() != index_cap_.size()) {
         std::cerr << "Inconsistent Dynamic List Index Length\n";
     }
-    size_t pos = 0;
-    for (size_t i = 0; i < index.size(); ++i )
-        pos = pos * index_cap_[i] + index[i];
-    return dynamic_list_[pos];
+    return dynamic_list_[GetPos([&](size_t i) { return index[i]; })];
 }
 
 template<class T>
@@ -56,12 +99,201 @@ const T& DynamicList<T>::operator[](const std::vector<size_t>& index) const {
     if (index.size() != index_cap_.size()) {
         std::cerr << "Inconsistent Dynamic List Index Length\n";
     }
-    size_t pos = 0;
-    for (size_t i = 0; i < index.size(); ++i )
-        pos = pos * index_cap_[i] + index[i];
-    return dynamic_list_[pos];
+    return dynamic_list_[GetPos([&](size_t i) { return index[i]; })];
+}
+
+// The sparse tables learn up to this many times their number of cells, and keep the most
+// frequent ones once all the tuples are seen
+const size_t kSparseLearningFactor = 4;
+
+/*
+ * SparseList holds the cells of a DynamicList with the same index caps that are actually
+ * used, up to max_size cells, in an open addressing hash table keyed by the row-major
+ * position of the cell. It is used when the dense list would be too large while only a few
+ * combinations of indexes occur.
+ */
+template<class T>
+class SparseList {
+  private:
+    std::vector<size_t> index_cap_;
+    std::vector<size_t> stride_;
+    size_t max_size_;
+    // The positions and the cells in the order of insertion
+    std::vector<size_t> pos_;
+    std::vector<T> sparse_list_;
+    // Each slot holds the index of a cell plus one, 0 marks an empty slot. The number of
+    // slots is a power of two, and at least twice the number of cells.
+    std::vector<unsigned> slot_;
+
+    // Return the slot holding the position, or the empty slot where it belongs
+    size_t FindSlot(size_t pos) const;
+    void Rehash(size_t num_of_slots);
+  public:
+    SparseList(const std::vector<size_t>& index_cap, size_t max_size);
+    size_t GetPos(const std::vector<size_t>& index) const;
+    // See GetRowMajorPos
+    template<class IndexFunc>
+    size_t GetPos(const IndexFunc& index) const { return GetRowMajorPos(stride_, index); }
+    // Return NULL if there is no cell at the position
+    T* Find(size_t pos);
+    const T* Find(size_t pos) const;
+    // Return the cell at the position, which is added if absent, or NULL if it is absent
+    // while there are max_size cells already
+    T* Insert(size_t pos);
+    // Sort the cells by position, so that the order of the cells does not depend on the
+    // order of insertion
+    void Sort();
+    // Keep only the cells of the given indexes, in the given order
+    void Retain(const std::vector<size_t>& index);
+    // Return the indexes of the num_of_cells cells with the largest counts in ascending
+    // order, ties are broken by position so that the choice does not depend on the order
+    // of insertion. count(i) is the count of the cell of index i.
+    template<class CountFunc>
+    std::vector<size_t> GetMostFrequentCells(size_t num_of_cells,
+                                             const CountFunc& count) const;
+    T& operator[](int index) { return sparse_list_[index]; }
+    const T& operator[](int index) const { return sparse_list_[index]; }
+    size_t GetPosOfCell(int index) const { return pos_[index]; }
+    // The index of a cell returned by Find or Insert, which is the order of its insertion
+    // until Sort is called
+    size_t GetIndexOfCell(const T* cell) const { return cell - sparse_list_.data(); }
+    size_t size() const { return sparse_list_.size(); }
+};
+
+template<class T>
+SparseList<T>::SparseList(const std::vector<size_t>& index_cap, size_t max_size) :
+    index_cap_(index_cap),
+    stride_(GetRowMajorStride(index_cap)),
+    max_size_(max_size),
+    slot_(16) {}
+
+template<class T>
+size_t SparseList<T>::GetPos(const std::vector<size_t>& index) const {
+    if (index.size() != index_cap_.size()) {
+        std::cerr << "Inconsistent Sparse List Index Length\n";
+    }
+    return GetPos([&](size_t i) { return index[i]; });
+}
+
+// Fibonacci hashing with linear probing
+template<class T>
+size_t SparseList<T>::FindSlot(size_t pos) const {
+    size_t mask = slot_.size() - 1;
+    size_t slot = (size_t)((pos * 11400714819323198485ull) >> 32) & mask;
+    while (slot_[slot] != 0 && pos_[slot_[slot] - 1] != pos)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+template<class T>
+void SparseList<T>::Rehash(size_t num_of_slots) {
+    slot_.assign(num_of_slots, 0);
+    for (size_t i = 0; i < pos_.size(); ++i)
+        slot_[FindSlot(pos_[i])] = i + 1;
+}
+
+template<class T>
+T* SparseList<T>::Find(size_t pos) {
+    unsigned index = slot_[FindSlot(pos)];
+    return (index == 0 ? NULL : &sparse_list_[index - 1]);
+}
+
+template<class T>
+const T* SparseList<T>::Find(size_t pos) const {
+    unsigned index = slot_[FindSlot(pos)];
+    return (index == 0 ? NULL : &sparse_list_[index - 1]);
+}
+
+template<class T>
+T* SparseList<T>::Insert(size_t pos) {
+    size_t slot = FindSlot(pos);
+    if (slot_[slot] != 0)
+        return &sparse_list_[slot_[slot] - 1];
+    if (sparse_list_.size() >= max_size_)
+        return NULL;
+    pos_.push_back(pos);
+    sparse_list_.push_back(T());
+    slot_[slot] = sparse_list_.size();
+    if (sparse_list_.size() * 2 > slot_.size())
+        Rehash(slot_.size() * 2);
+    return &sparse_list_.back();
+}
+
+template<class T>
+void SparseList<T>::Sort() {
+    std::vector<size_t> order(pos_.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return pos_[a] < pos_[b];
+    });
+    Retain(order);
+}
+
+template<class T>
+void SparseList<T>::Retain(const std::vector<size_t>& index) {
+    std::vector<size_t> pos(index.size());
+    std::vector<T> sparse_list(index.size());
+    for (size_t i = 0; i < index.size(); ++i) {
+        pos[i] = pos_[index[i]];
+        sparse_list[i] = std::move(sparse_list_[index[i]]);
+    }
+    pos_.swap(pos);
+    sparse_list_.swap(sparse_list);
+    Rehash(slot_.size());
+}
+
+template<class T>
+template<class CountFunc>
+std::vector<size_t> SparseList<T>::GetMostFrequentCells(size_t num_of_cells,
+                                                        const CountFunc& count) const {
+    std::vector< std::pair<int, size_t> > order;
+    for (size_t i = 0; i < pos_.size(); ++i)
+        order.push_back(std::make_pair(count(i), i));
+    num_of_cells = std::min(num_of_cells, order.size());
+    std::partial_sort(order.begin(), order.begin() + num_of_cells, order.end(),
+        [this](const std::pair<int, size_t>& a, const std::pair<int, size_t>& b) {
+            return a.first > b.first || (a.first == b.first && pos_[a.second] < pos_[b.second]);
+        });
+    std::vector<size_t> index;
+    for (size_t i = 0; i < num_of_cells; ++i)
+        index.push_back(order[i].second);
+    std::sort(index.begin(), index.end());
+    return index;
 }
 
+/*
+ * CountMatrix keeps the counts of the values of many cells in one contiguous row-major
+ * matrix, one row per cell. The rows are widened geometrically whenever a larger value is
+ * added, so that adding a count is a single increment once the range of the values is
+ * known, and more rows can be appended as cells are added.
+ */
+class CountMatrix {
+  private:
+    std::vector<int> count_;
+    size_t num_of_rows_;
+    size_t row_size_;
+
+    void Widen(size_t row_size);
+  public:
+    explicit CountMatrix(size_t num_of_rows) : num_of_rows_(num_of_rows), row_size_(0) {}
+    void AddRows(size_t num_of_rows);
+    void AddCount(size_t row, size_t value, int count) {
+        if (value >= row_size_)
+            Widen(std::max(value + 1, row_size_ * 2));
+        count_[row * row_size_ + value] += count;
+    }
+    // Add the counts of a row of another matrix to the row
+    void MergeRow(size_t row, const CountMatrix& other, size_t other_row);
+    // Return the count of the value in the row, values beyond the row size have count 0
+    int GetCount(size_t row, size_t value) const {
+        return (value < row_size_ ? count_[row * row_size_ + value] : 0);
+    }
+    // Release the memory of the counts, the matrix is left with no rows
+    void Clear();
+    size_t GetNumOfRows() const { return num_of_rows_; }
+};
+
 /*
  * The quantization procedure transforms raw count of each individual bins to probability
  * interval boundaries, such that all probability boundary will have base 16. This function
@@ -79,7 +311,6 @@ inline Prob GetProb(int count, int base) { return Prob(count, base); }
 inline Prob GetProb(double value) { return Prob((int)round(value * (1 << 16)), 16); }
 inline Prob GetZeroProb() { return Prob(0, 0); }
 inline Prob GetOneProb() { return Prob(1, 0); }
-inline UnitProbInterval GetWholeProbInterval() { return UnitProbInterval(0, 0); }
 // Trunc to nearest value within that base
 inline int CastInt(const Prob& prob, int base) {
     if (prob.exp <= base)
@@ -112,6 +343,18 @@ inline bool operator==(const Prob& left, const Prob& right) {
 inline bool operator!=(const Prob& left, const Prob& right) {
     return (left.num << (40 - left.exp)) != (right.num << (40 - right.exp));
 }
+// Compare the viewed boundaries
+inline bool operator==(const ProbSegs& left, const ProbSegs& right) {
+    if (left.size() != right.size())
+        return false;
+    for (size_t i = 0; i < left.size(); ++i)
+    if (left[i] != right[i])
+        return false;
+    return true;
+}
+inline bool operator!=(const ProbSegs& left, const ProbSegs& right) {
+    return !(left == right);
+}
 inline Prob operator+(const Prob& left, const Prob& right) {
     if (left.exp < right.exp)
         return Prob((left.num << (right.exp - left.exp)) + right.num, right.exp);
@@ -130,30 +373,6 @@ inline Prob operator*(const Prob& left, const Prob& right) {
 
 // Get the length of given ProbInterval
 inline Prob GetLen(const ProbInterval& PI) { return PI.r - PI.l; }
-/*
- * Compute the product of probability intervals and emits bytes when possible, 
- * the emitted bytes are directly concatenated to the end of emit_bytes (i.e., do
- * not initialize emit_bytes)
- */
-ProbInterval GetPIProduct(const ProbInterval& left, const ProbInterval& right,
-                             std::vector<unsigned char>* emit_bytes);
-
-/*
- * Reduce a vector of probability intervals to their product
- */
-ProbInterval ReducePIProduct(const std::vector<ProbInterval>& vec,
-                             std::vector<unsigned char>* emit_bytes);
-
-/*
- * Compute the ratio point of the ProbInterval
- */
-Prob GetPIRatioPoint(const ProbInterval& PI, const Prob& ratio);
-
-/*
- * Reduce ProbInterval according given bytes
- */
-void ReducePI(UnitProbInterval* PIt, const std::vector<unsigned char>& bytes);
-
 /*
  * Get value of cumulative distribution function of exponential distribution
  */
@@ -176,6 +395,13 @@ void ConvertSinglePrecision(double val, unsigned char bytes[4]);
  */
 double ConvertSinglePrecision(unsigned char bytes[4]);
 
+/*
+ * Run task(worker, i) for every i in [0, n) on num_of_threads worker threads, worker is
+ * the index of the thread running the task. Tasks are handed out in increasing order of
+ * i, and the function returns after all the tasks finish.
+ */
+void ParallelFor(size_t n, int num_of_threads, const std::function<void(int, size_t)>& task);
+
 /*
  * Extract one byte from 32-bit unsigned int
  */
@@ -218,8 +444,6 @@ inline unsigned ComputePrefix(const BitString& bit_string, int prefix_length) {
     int shift_bit = 32 - prefix_length;
     return (bit_string.bits[0] >> shift_bit) & ((1 << prefix_length) - 1);
 }
-// Find the minimal BitString which has the corresponding probability interval lies within [l, r]
-void GetBitStringFromProbInterval(BitString *str, const ProbInterval& prob);
 
 } // namespace db_compress
 
@@ -29,6 +29,86 @@ void TestDynamicList() {
     dynamic_list[index] = 3;
     if (dynamic_list.size() != 6 || another[index] != 3)
         std::cerr << "Dynamic List Unit Test Failed!\n";   
+    // The positions of any number of dimensions agree with the row-major order
+    for (size_t dims = 0; dims <= 5; ++dims) {
+        std::vector<size_t> caps(dims, 3), idx(dims, 2);
+        DynamicList<int> list(caps);
+        size_t pos = list.GetPos([&](size_t i) { return idx[i]; });
+        if (pos != list.size() - 1 || &list[idx] != &list[pos])
+            std::cerr << "Dynamic List Unit Test Failed!\n";
+    }
+}
+
+void TestSparseList() {
+    std::vector<size_t> cap;
+    cap.push_back(1000); cap.push_back(1000); cap.push_back(1000);
+    SparseList<int> sparse_list(cap, 100);
+    std::vector<size_t> index;
+    index.push_back(0); index.push_back(1); index.push_back(2);
+    if (sparse_list.GetPos(index) != 1002 || sparse_list.Find(1002) != NULL)
+        std::cerr << "Sparse List Unit Test Failed!\n";
+    // Inserted in descending order of positions, with many rehashes in between
+    for (int i = 199; i >= 0; --i) {
+        int* cell = sparse_list.Insert(i * 997);
+        if ((i >= 100) != (cell != NULL))
+            std::cerr << "Sparse List Unit Test Failed!\n";
+        if (cell != NULL)
+            *cell = i;
+    }
+    // The list is full, but the cells already present are still found
+    if (sparse_list.size() != 100 || sparse_list.Insert(199 * 997) == NULL)
+        std::cerr << "Sparse List Unit Test Failed!\n";
+    sparse_list.Sort();
+    const SparseList<int>& another = sparse_list;
+    for (int i = 0; i < 200; ++i) {
+        const int* cell = another.Find(i * 997);
+        if ((i >= 100) != (cell != NULL) || (cell != NULL && *cell != i))
+            std::cerr << "Sparse List Unit Test Failed!\n";
+    }
+    for (size_t i = 0; i < sparse_list.size(); ++i)
+    if (sparse_list[i] != (int)i + 100 || sparse_list.GetPosOfCell(i) != (i + 100) * 997)
+        std::cerr << "Sparse List Unit Test Failed!\n";
+    // The ten cells of count 9 are kept, followed by the two of count 8 at the smallest
+    // positions
+    std::vector<size_t> kept = sparse_list.GetMostFrequentCells(12,
+        [&](size_t i) { return sparse_list[i] % 10; });
+    sparse_list.Retain(kept);
+    if (kept.size() != 12 || sparse_list.size() != 12)
+        std::cerr << "Sparse List Unit Test Failed!\n";
+    for (int i = 100; i < 200; ++i) {
+        const int* cell = another.Find(i * 997);
+        bool is_kept = (i % 10 == 9 || i == 108 || i == 118);
+        if (is_kept != (cell != NULL) || (cell != NULL && *cell != i))
+            std::cerr << "Sparse List Unit Test Failed!\n";
+    }
+}
+
+void TestCountMatrix() {
+    CountMatrix counts(3), other(3);
+    counts.AddCount(0, 1, 2);
+    counts.AddCount(2, 0, 1);
+    // Widen the rows twice while keeping the counts
+    counts.AddCount(1, 4, 1);
+    counts.AddCount(2, 20, 3);
+    other.AddCount(2, 30, 5);
+    other.AddCount(2, 0, 1);
+    counts.AddRows(1);
+    counts.AddCount(3, 2, 1);
+    counts.MergeRow(2, other, 2);
+    if (counts.GetNumOfRows() != 4 || counts.GetCount(0, 1) != 2 ||
+        counts.GetCount(1, 4) != 1 || counts.GetCount(2, 0) != 2 ||
+        counts.GetCount(2, 20) != 3 || counts.GetCount(2, 30) != 5 ||
+        counts.GetCount(3, 2) != 1 || counts.GetCount(3, 1000) != 0)
+        std::cerr << "Count Matrix Unit Test Failed!\n";
+    int total = 0;
+    for (size_t i = 0; i < 4; ++i)
+    for (size_t j = 0; j < 40; ++j)
+        total += counts.GetCount(i, j);
+    if (total != 14)
+        std::cerr << "Count Matrix Unit Test Failed!\n";
+    counts.Clear();
+    if (counts.GetNumOfRows() != 0)
+        std::cerr << "Count Matrix Unit Test Failed!\n";
 }
 
 void TestQuantization() {
@@ -45,41 +125,6 @@ void TestQuantization() {
         std::cerr << "Quantization Unit Test Failed!\n";
 }
 
-void TestPIProduct() {
-    std::vector<unsigned char> emit_bytes;
-    // Test #1:
-    ProbInterval PI(GetProb(3, 3), GetProb(5, 3));
-    PI = GetPIProduct(PI, ProbInterval(GetProb(1, 2), GetProb(3, 2)), &emit_bytes);
-    if (PI.l != GetProb(14, 5) || PI.r != GetProb(18, 5) || emit_bytes.size() != 0)
-        std::cerr << "PIProduct Unit Test #1 Failed!\n";
-    // Test #2:
-    PI = ProbInterval(GetProb(14,5), GetProb(18,5));
-    PI = GetPIProduct(PI, ProbInterval(GetProb(1, 13), GetProb(2, 13)), NULL);
-    if (PI.l != GetProb(28673, 16) || PI.r != GetProb(28674, 16))
-        std::cerr << "PIProduct Unit Test #2 Failed!\n";
-    // Test #3:
-    PI = ProbInterval(GetProb(28673,16), GetProb(28674,16));
-    PI = GetPIProduct(PI, ProbInterval(GetZeroProb(), GetOneProb()), &emit_bytes);
-    if (emit_bytes.size() != 2 || emit_bytes[0] != 0x70 || emit_bytes[1] != 0x01 ||
-        PI.l != GetZeroProb() || PI.r != GetOneProb())
-        std::cerr << "PIProduct Unit Test #3 Failed!\n";
-    // Test #4:
-    ProbInterval PIt(GetProb(65535, 17), GetProb(65538, 17));
-    PI = ProbInterval(GetZeroProb(), GetOneProb());
-    emit_bytes.clear();
-    PI = GetPIProduct(PI, PIt, &emit_bytes);
-    if (PI.l != GetZeroProb() || PI.r != GetOneProb() || 
-        emit_bytes.size() != 2 || emit_bytes[0] != 0x80 || emit_bytes[1] != 0)
-        std::cerr << "PIProduct Unit Test #4 Failed!\n";
-    // Test #5:
-    UnitProbInterval PIb(14 * 2048 + 1, 16);
-    emit_bytes.clear();
-    emit_bytes.push_back(0x70); emit_bytes.push_back(0x01);
-    ReducePI(&PIb, emit_bytes);
-    if (PIb.num != 0 || PIb.exp != 0)
-        std::cerr << "PIProduct Unit Test #5 Failed!\n";
-}
-
 void TestFloatQuantization() {
     unsigned char bytes[4];
     ConvertSinglePrecision(0.1, bytes);
@@ -107,15 +152,13 @@ void TestBitString() {
         std::cerr << "Bit String Unit Test Failed!\n";
     if (ComputePrefix(str, 12) != 0xfff)
         std::cerr << "Bit String Unit Test Failed!\n";
-    GetBitStringFromProbInterval(&str, ProbInterval(GetProb(7, 7), GetProb(9, 7)) );
-    if (str.length != 7 || str.bits[0] != 0x10000000)
-        std::cerr << "Bit String Unit Test Failed!\n";
 }
 
 void Test() {
     TestDynamicList();
+    TestSparseList();
+    TestCountMatrix();
     TestQuantization();
-    TestPIProduct();
     TestFloatQuantization();
     TestBitString();
 }